@@ -0,0 +1,250 @@
+#include <string.h>
+#include "compositor.h"
+
+// classic 5x7 font, ' ' .. 'Z', column-major with bit0 = top row
+static const uint8_t font5x7[][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, // ' '
+    {0x00, 0x00, 0x5F, 0x00, 0x00}, // !
+    {0x00, 0x07, 0x00, 0x07, 0x00}, // "
+    {0x14, 0x7F, 0x14, 0x7F, 0x14}, // #
+    {0x24, 0x2A, 0x7F, 0x2A, 0x12}, // $
+    {0x23, 0x13, 0x08, 0x64, 0x62}, // %
+    {0x36, 0x49, 0x55, 0x22, 0x50}, // &
+    {0x00, 0x05, 0x03, 0x00, 0x00}, // '
+    {0x00, 0x1C, 0x22, 0x41, 0x00}, // (
+    {0x00, 0x41, 0x22, 0x1C, 0x00}, // )
+    {0x14, 0x08, 0x3E, 0x08, 0x14}, // *
+    {0x08, 0x08, 0x3E, 0x08, 0x08}, // +
+    {0x00, 0x50, 0x30, 0x00, 0x00}, // ,
+    {0x08, 0x08, 0x08, 0x08, 0x08}, // -
+    {0x00, 0x60, 0x60, 0x00, 0x00}, // .
+    {0x20, 0x10, 0x08, 0x04, 0x02}, // /
+    {0x3E, 0x51, 0x49, 0x45, 0x3E}, // 0
+    {0x00, 0x42, 0x7F, 0x40, 0x00}, // 1
+    {0x42, 0x61, 0x51, 0x49, 0x46}, // 2
+    {0x21, 0x41, 0x45, 0x4B, 0x31}, // 3
+    {0x18, 0x14, 0x12, 0x7F, 0x10}, // 4
+    {0x27, 0x45, 0x45, 0x45, 0x39}, // 5
+    {0x3C, 0x4A, 0x49, 0x49, 0x30}, // 6
+    {0x01, 0x71, 0x09, 0x05, 0x03}, // 7
+    {0x36, 0x49, 0x49, 0x49, 0x36}, // 8
+    {0x06, 0x49, 0x49, 0x29, 0x1E}, // 9
+    {0x00, 0x36, 0x36, 0x00, 0x00}, // :
+    {0x00, 0x56, 0x36, 0x00, 0x00}, // ;
+    {0x08, 0x14, 0x22, 0x41, 0x00}, // <
+    {0x14, 0x14, 0x14, 0x14, 0x14}, // =
+    {0x00, 0x41, 0x22, 0x14, 0x08}, // >
+    {0x02, 0x01, 0x51, 0x09, 0x06}, // ?
+    {0x32, 0x49, 0x79, 0x41, 0x3E}, // @
+    {0x7E, 0x11, 0x11, 0x11, 0x7E}, // A
+    {0x7F, 0x49, 0x49, 0x49, 0x36}, // B
+    {0x3E, 0x41, 0x41, 0x41, 0x22}, // C
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, // D
+    {0x7F, 0x49, 0x49, 0x49, 0x41}, // E
+    {0x7F, 0x09, 0x09, 0x09, 0x01}, // F
+    {0x3E, 0x41, 0x49, 0x49, 0x7A}, // G
+    {0x7F, 0x08, 0x08, 0x08, 0x7F}, // H
+    {0x00, 0x41, 0x7F, 0x41, 0x00}, // I
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, // J
+    {0x7F, 0x08, 0x14, 0x22, 0x41}, // K
+    {0x7F, 0x40, 0x40, 0x40, 0x40}, // L
+    {0x7F, 0x02, 0x0C, 0x02, 0x7F}, // M
+    {0x7F, 0x04, 0x08, 0x10, 0x7F}, // N
+    {0x3E, 0x41, 0x41, 0x41, 0x3E}, // O
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, // P
+    {0x3E, 0x41, 0x51, 0x21, 0x5E}, // Q
+    {0x7F, 0x09, 0x19, 0x29, 0x46}, // R
+    {0x46, 0x49, 0x49, 0x49, 0x31}, // S
+    {0x01, 0x01, 0x7F, 0x01, 0x01}, // T
+    {0x3F, 0x40, 0x40, 0x40, 0x3F}, // U
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, // V
+    {0x3F, 0x40, 0x38, 0x40, 0x3F}, // W
+    {0x63, 0x14, 0x08, 0x14, 0x63}, // X
+    {0x07, 0x08, 0x70, 0x08, 0x07}, // Y
+    {0x61, 0x51, 0x49, 0x45, 0x43}, // Z
+};
+
+#define FONT_W 5
+#define FONT_ADVANCE (FONT_W + 1)
+
+// floor(v / 2^COMP_FP_SHIFT), also for negative positions
+static inline int32_t fp_to_int(int32_t v)
+{
+  return (v >= 0) ? (v >> COMP_FP_SHIFT) : -(int32_t)(((uint32_t)-v + (1u << COMP_FP_SHIFT) - 1) >> COMP_FP_SHIFT);
+}
+
+// bits [off, off + 64) of a multi-word row, zero outside of it
+static inline uint64_t row_window(const uint64_t *row, uint16_t words, int32_t off)
+{
+  if (off < 0)
+  {
+    if (off <= -64 || words == 0)
+      return 0;
+    return row[0] << -off;
+  }
+  uint32_t i = (uint32_t)off >> 6;
+  uint32_t sh = (uint32_t)off & 63;
+  uint64_t lo = (i < words) ? row[i] : 0;
+  if (sh == 0)
+    return lo;
+  uint64_t hi = (i + 1 < words) ? row[i + 1] : 0;
+  return (lo >> sh) | (hi << (64 - sh));
+}
+
+void comp_init(comp_canvas_t *canvas, uint8_t panels)
+{
+  memset(canvas, 0, sizeof(*canvas));
+  if (panels < 1)
+    panels = 1;
+  if (panels > COMP_MAX_PANELS)
+    panels = COMP_MAX_PANELS;
+  canvas->panels = panels;
+  canvas->width = panels * 8;
+  canvas->width_mask = (canvas->width >= 64) ? ~0ULL : ((1ULL << canvas->width) - 1);
+  // panels come out of reset in an unknown state, so the first flush writes everything
+  canvas->dirty = 0xFF;
+}
+
+comp_layer_t *comp_add_layer(comp_canvas_t *canvas, comp_blend_t blend)
+{
+  if (canvas->layer_count >= COMP_MAX_LAYERS)
+    return NULL;
+  comp_layer_t *layer = &canvas->layers[canvas->layer_count++];
+  comp_layer_clear(layer);
+  layer->blend = blend;
+  layer->visible = true;
+  return layer;
+}
+
+void comp_layer_clear(comp_layer_t *layer)
+{
+  memset(layer->plane, 0, sizeof(layer->plane));
+}
+
+void comp_sprite_step(comp_sprite_t *sprite)
+{
+  sprite->x += sprite->vx;
+  sprite->y += sprite->vy;
+}
+
+void comp_draw_sprite(const comp_canvas_t *canvas, comp_layer_t *layer, const comp_sprite_t *sprite)
+{
+  int32_t px = fp_to_int(sprite->x);
+  int32_t py = fp_to_int(sprite->y);
+  // whole sprite off the canvas: nothing to clip row by row
+  if (px >= canvas->width || px + sprite->w <= 0 || py >= COMP_ROWS || py + sprite->h <= 0)
+    return;
+
+  int r0 = (py < 0) ? -py : 0;
+  int r1 = (py + sprite->h > COMP_ROWS) ? COMP_ROWS - py : sprite->h;
+  for (int r = r0; r < r1; ++r)
+  {
+    // bits above the sprite's own width are not part of it
+    uint64_t bits = sprite->bits[r] & ((1u << sprite->w) - 1);
+    bits = (px >= 0) ? (bits << px) : (bits >> -px);
+    layer->plane[py + r] |= bits & canvas->width_mask;
+  }
+}
+
+uint16_t comp_text_strip(comp_strip_t *strip, const char *text)
+{
+  uint32_t capacity = (uint32_t)strip->words * 64;
+  uint32_t x = 0;
+  memset(strip->rows, 0, sizeof(uint64_t) * COMP_ROWS * strip->words);
+
+  for (const char *p = text; *p && x + FONT_W <= capacity; ++p)
+  {
+    char ch = *p;
+    if (ch >= 'a' && ch <= 'z')
+      ch -= 'a' - 'A';
+    if (ch < ' ' || ch > 'Z')
+      ch = '?';
+    const uint8_t *glyph = font5x7[ch - ' '];
+    for (int c = 0; c < FONT_W; ++c, ++x)
+    {
+      for (int r = 0; r < 7; ++r)
+      {
+        if (glyph[c] & (1 << r))
+        {
+          strip->rows[r * strip->words + (x >> 6)] |= 1ULL << (x & 63);
+        }
+      }
+    }
+    x += FONT_ADVANCE - FONT_W;
+  }
+  // drop the trailing gap column
+  strip->width = (x > 0) ? (uint16_t)(x - (FONT_ADVANCE - FONT_W)) : 0;
+  return strip->width;
+}
+
+void comp_draw_strip(const comp_canvas_t *canvas, comp_layer_t *layer, const comp_strip_t *strip, int32_t x)
+{
+  if (x >= canvas->width || x + strip->width <= 0)
+    return;
+  for (int r = 0; r < COMP_ROWS; ++r)
+  {
+    layer->plane[r] |= row_window(&strip->rows[r * strip->words], strip->words, -x) & canvas->width_mask;
+  }
+}
+
+void comp_render(comp_canvas_t *canvas)
+{
+  uint64_t acc[COMP_ROWS] = {0};
+  for (int i = 0; i < canvas->layer_count; ++i)
+  {
+    const comp_layer_t *layer = &canvas->layers[i];
+    if (!layer->visible)
+      continue;
+    switch (layer->blend)
+    {
+    case COMP_BLEND_OR:
+      for (int r = 0; r < COMP_ROWS; ++r)
+        acc[r] |= layer->plane[r];
+      break;
+    case COMP_BLEND_XOR:
+      for (int r = 0; r < COMP_ROWS; ++r)
+        acc[r] ^= layer->plane[r];
+      break;
+    case COMP_BLEND_MASK:
+      for (int r = 0; r < COMP_ROWS; ++r)
+        acc[r] &= layer->plane[r];
+      break;
+    }
+  }
+
+  uint8_t dirty = 0;
+  for (int r = 0; r < COMP_ROWS; ++r)
+  {
+    canvas->out[r] = acc[r] & canvas->width_mask;
+    if (canvas->out[r] != canvas->shown[r])
+      dirty |= 1 << r;
+  }
+  canvas->dirty |= dirty;
+}
+
+int comp_flush(comp_canvas_t *canvas, comp_row_writer_t writer, void *ctx)
+{
+  uint8_t bytes[COMP_MAX_PANELS];
+  int written = 0;
+  uint8_t dirty = canvas->dirty;
+  while (dirty)
+  {
+    int r = __builtin_ctz(dirty);
+    dirty &= dirty - 1;
+    uint64_t row = canvas->out[r];
+    for (int p = 0; p < canvas->panels; ++p)
+    {
+      bytes[p] = (uint8_t)(row >> (8 * p));
+    }
+    writer((uint8_t)r, bytes, canvas->panels, ctx);
+    canvas->shown[r] = row;
+    written++;
+  }
+  canvas->dirty = 0;
+  return written;
+}
+
+void comp_invalidate(comp_canvas_t *canvas)
+{
+  canvas->dirty = 0xFF;
+}
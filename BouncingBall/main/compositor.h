@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bitplane compositor for a chain of 8x8 MAX7219 panels.
+// Every canvas row is one uint64_t (bit x = column x, panel p owns bits 8p..8p+7),
+// so blending a whole row across all panels is a single word-wide operation.
+// Nothing in here touches ESP-IDF, so it also builds on the host (see bench_compositor.c).
+
+#define COMP_ROWS 8
+#define COMP_MAX_PANELS 8
+#define COMP_MAX_LAYERS 4
+
+// sprite positions and velocities are fixed point with 8 fractional bits
+#define COMP_FP_SHIFT 8
+#define COMP_FP(v) ((int32_t)((v) * (1 << COMP_FP_SHIFT)))
+
+typedef enum
+{
+  COMP_BLEND_OR,   // light the layer's pixels
+  COMP_BLEND_XOR,  // invert whatever is below the layer's pixels
+  COMP_BLEND_MASK, // keep only the pixels below that the layer has lit
+} comp_blend_t;
+
+typedef struct
+{
+  uint64_t plane[COMP_ROWS];
+  comp_blend_t blend;
+  bool visible;
+} comp_layer_t;
+
+typedef struct
+{
+  const uint8_t *bits; // one byte per row, bit0 = leftmost column
+  uint8_t w, h;        // at most 8x8
+  int32_t x, y;        // top-left corner, fixed point
+  int32_t vx, vy;      // motion per frame, fixed point
+} comp_sprite_t;
+
+// wide 8-row bitmap (e.g. rendered text) that is blitted through the canvas window
+typedef struct
+{
+  uint64_t *rows;  // COMP_ROWS * words, row-major
+  uint16_t words;  // capacity of one row in 64-bit words
+  uint16_t width;  // columns in use
+} comp_strip_t;
+
+typedef struct
+{
+  uint8_t panels;
+  uint8_t width;
+  uint64_t width_mask;
+  uint8_t layer_count;
+  comp_layer_t layers[COMP_MAX_LAYERS];
+  uint64_t out[COMP_ROWS];   // result of the last comp_render()
+  uint64_t shown[COMP_ROWS]; // what the panels are currently showing
+  uint8_t dirty;             // bit r set = row r differs from the panels
+} comp_canvas_t;
+
+// called once per changed row; bytes[p] is the row data for panel p
+typedef void (*comp_row_writer_t)(uint8_t row, const uint8_t *bytes, uint8_t panels, void *ctx);
+
+void comp_init(comp_canvas_t *canvas, uint8_t panels);
+comp_layer_t *comp_add_layer(comp_canvas_t *canvas, comp_blend_t blend);
+void comp_layer_clear(comp_layer_t *layer);
+
+void comp_sprite_step(comp_sprite_t *sprite);
+void comp_draw_sprite(const comp_canvas_t *canvas, comp_layer_t *layer, const comp_sprite_t *sprite);
+
+// renders text with the built-in 5x7 font (one blank column between glyphs), returns columns used
+uint16_t comp_text_strip(comp_strip_t *strip, const char *text);
+// places strip column 0 at canvas column x (x may be negative or past the right edge)
+void comp_draw_strip(const comp_canvas_t *canvas, comp_layer_t *layer, const comp_strip_t *strip, int32_t x);
+
+// blends all visible layers into out[] and marks the rows that changed
+void comp_render(comp_canvas_t *canvas);
+// hands only the dirty rows to the writer, returns how many rows were written
+int comp_flush(comp_canvas_t *canvas, comp_row_writer_t writer, void *ctx);
+// forces every row out on the next flush (e.g. after the panels were reset)
+void comp_invalidate(comp_canvas_t *canvas);
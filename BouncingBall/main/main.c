@@ -1,16 +1,20 @@
 #include <stdio.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "driver/spi_master.h"
 #include "driver/timer.h"
 #include "driver/gpio.h"
+#include "compositor.h"
+#include "profiler.h"
 
 static const char *TAG = "bouncing_ball";
 
 #define SPI_CLK_GPIO GPIO_NUM_18
 #define SPI_MOSI_GPIO GPIO_NUM_23
 #define SPI_CS_GPIO GPIO_NUM_5
+#define MATRIX_PANELS 1 // number of daisy-chained 8x8 panels (max COMP_MAX_PANELS)
 
 #define FRAME_TIME_MS 100
 #define INIT_POS_X 3
@@ -27,13 +31,30 @@ int8_t ball_y = INIT_POS_Y;
 int8_t vel_x = INIT_VEL_X;
 int8_t vel_y = INIT_VEL_Y;
 uint32_t frame_count = 0;
+volatile bool finished = false;
 
-static void max7219_write(uint8_t reg, uint8_t val)
+static int prof_render;
+static int prof_flush;
+
+static comp_canvas_t canvas;
+static comp_layer_t *wall_layer;
+static comp_layer_t *ball_layer;
+static const uint8_t ball_bits[1] = {0x01};
+static comp_sprite_t ball = {.bits = ball_bits, .w = 1, .h = 1};
+
+// one transaction writes reg on every panel of the chain, vals[p] goes to panel p
+static void max7219_write_chain(uint8_t reg, const uint8_t *vals, uint8_t panels)
 {
-  uint16_t word = (reg << 8) | val;
+  // the first word shifted in ends up in the farthest panel, so send the last panel first
+  uint8_t tx[2 * COMP_MAX_PANELS];
+  for (int p = 0; p < panels; ++p)
+  {
+    tx[2 * (panels - 1 - p)] = reg;
+    tx[2 * (panels - 1 - p) + 1] = vals[p];
+  }
   spi_transaction_t t = {
-      .length = 16,
-      .tx_buffer = &word,
+      .length = 16 * panels,
+      .tx_buffer = tx,
   };
   esp_err_t ret = spi_device_transmit(max7219, &t);
   if (ret != ESP_OK)
@@ -42,6 +63,19 @@ static void max7219_write(uint8_t reg, uint8_t val)
   }
 }
 
+static void max7219_write(uint8_t reg, uint8_t val)
+{
+  uint8_t vals[COMP_MAX_PANELS];
+  memset(vals, val, sizeof(vals));
+  max7219_write_chain(reg, vals, MATRIX_PANELS);
+}
+
+static void max7219_write_row(uint8_t row, const uint8_t *bytes, uint8_t panels, void *ctx)
+{
+  // Digit1->row0 ... Digit8->row7
+  max7219_write_chain(row + 1, bytes, panels);
+}
+
 static void max7219_init(void)
 {
   // decode mode off
@@ -60,26 +94,34 @@ static void max7219_init(void)
   // }
 }
 
-static void draw_frame(void)
+static void init_canvas(void)
 {
-  uint8_t buffer[8] = {0};
-  // draw left wall at x=0
-  for (int y = 0; y < 8; ++y)
+  comp_init(&canvas, MATRIX_PANELS);
+  wall_layer = comp_add_layer(&canvas, COMP_BLEND_OR);
+  ball_layer = comp_add_layer(&canvas, COMP_BLEND_OR);
+  // draw left wall at x=0, it never moves so it is drawn only once
+  for (int y = 0; y < COMP_ROWS; ++y)
   {
-    buffer[y] |= 0x01;
-  }
-  // draw ball at (ball_x, ball_y)
-  if (ball_x >= 1 && ball_x < 8 && ball_y >= 0 && ball_y < 8)
-  {
-    buffer[ball_y] |= (1 << ball_x);
-  }
-  // send rows: Digit1->row0 ... Digit8->row7
-  for (int row = 0; row < 8; ++row)
-  {
-    max7219_write(row + 1, buffer[row]);
+    wall_layer->plane[y] |= 0x01;
   }
 }
 
+static void draw_frame(void)
+{
+  // draw ball at (ball_x, ball_y), off-canvas parts are clipped by the compositor
+  PROF_BEGIN(render_start);
+  comp_layer_clear(ball_layer);
+  ball.x = COMP_FP(ball_x);
+  ball.y = COMP_FP(ball_y);
+  comp_draw_sprite(&canvas, ball_layer, &ball);
+  comp_render(&canvas);
+  PROF_END(prof_render, render_start);
+  // only the rows that changed since the last frame go out over SPI
+  PROF_BEGIN(flush_start);
+  comp_flush(&canvas, max7219_write_row, NULL);
+  PROF_END(prof_flush, flush_start);
+}
+
 static bool IRAM_ATTR timer_isr_callback(void *args)
 {
   // clear interrupt
@@ -112,6 +154,7 @@ static bool IRAM_ATTR timer_isr_callback(void *args)
     ESP_LOGI(TAG, "Frame count: %lu\n", frame_count);
     // disable further interrupts
     timer_disable_intr(TIMER_GROUP_0, TIMER_0);
+    finished = true;
   }
   return true; // keep alarm active
 }
@@ -160,12 +203,22 @@ void app_main(void)
 
   // 3) init MAX7219
   max7219_init();
+  init_canvas();
+
+  prof_render = prof_register("frame_render");
+  prof_flush = prof_register("spi_flush");
 
   // 4) init timer for frame updates
   init_timer();
 
   ESP_LOGI(TAG, "Bouncing ball started. FPS=%d", 1000 / FRAME_TIME_MS);
   // main task can idle or perform other work
+  while (!finished)
+  {
+    vTaskDelay(pdMS_TO_TICKS(1000));
+  }
+  // frame timings are only printed once the animation is over
+  prof_dump();
   while (1)
   {
     vTaskDelay(pdMS_TO_TICKS(1000));
@@ -2,6 +2,9 @@
 #include "freertos/FreeRTOS.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "profiler.h"
+#include "taskplace.h"
+#include "pixmath.h"
 #include <stdlib.h>
 
 #define MATRIX_SIZE 4
@@ -18,14 +21,16 @@ static SemaphoreHandle_t row_mutex;
 static SemaphoreHandle_t sum_mutex;
 static SemaphoreHandle_t done_count_mul;
 
+static int prof_row_claim;
+static int prof_row;
+
 void multiply_task(void *arg)
 {
-  int core_id = esp_cpu_get_core_id();
-  int64_t start_time, end_time, duration = 0;
   int row;
   while (true)
   {
-    start_time = esp_timer_get_time();
+    PROF_BEGIN(row_start);
+    PROF_BEGIN(claim_start);
     xSemaphoreTake(row_mutex, portMAX_DELAY);
     if (current_row >= MATRIX_SIZE)
     {
@@ -34,6 +39,7 @@ void multiply_task(void *arg)
     }
     row = current_row++;
     xSemaphoreGive(row_mutex);
+    PROF_END(prof_row_claim, claim_start);
     for (int col = 0; col < MATRIX_SIZE; col++)
     {
       int result = 0;
@@ -46,14 +52,81 @@ void multiply_task(void *arg)
       sum += result;
       xSemaphoreGive(sum_mutex);
     }
-    end_time = esp_timer_get_time();
-    duration = end_time - start_time;
-    ESP_LOGI(TAG, "core%d: row%d in %lld", core_id, row, duration);
+    // per-row timing goes to the profiler, logging here would skew the other core's rows
+    PROF_END(prof_row, row_start);
   }
   xSemaphoreGive(done_count_mul);
   vTaskDelete(NULL);
 }
 
+#define BENCH_MAT 64
+#define BENCH_REPS 16
+
+static int16_t a16[BENCH_MAT * BENCH_MAT] PM_ALIGNED;
+static int16_t b16[BENCH_MAT * BENCH_MAT] PM_ALIGNED;
+static int8_t a8[BENCH_MAT * BENCH_MAT] PM_ALIGNED;
+static int8_t b8[BENCH_MAT * BENCH_MAT] PM_ALIGNED;
+static int16_t c16[BENCH_MAT * BENCH_MAT];
+static volatile int32_t sink;
+
+// one untimed warm-up call each (caches, flash fetch), then the fastest of BENCH_REPS
+// interleaved runs, so neither side pays the cold misses or an interrupt
+#define BENCH_PAIR(ref_expr, kernel_expr, ref_min, kernel_min) \
+  do                                                          \
+  {                                                           \
+    ref_expr;                                                 \
+    kernel_expr;                                              \
+    ref_min = kernel_min = UINT32_MAX;                        \
+    for (int r_ = 0; r_ < BENCH_REPS; ++r_)                   \
+    {                                                         \
+      uint32_t t0 = esp_cpu_get_cycle_count();                \
+      ref_expr;                                               \
+      uint32_t t1 = esp_cpu_get_cycle_count();                \
+      kernel_expr;                                            \
+      uint32_t t2 = esp_cpu_get_cycle_count();                \
+      if (t1 - t0 < ref_min)                                  \
+        ref_min = t1 - t0;                                    \
+      if (t2 - t1 < kernel_min)                               \
+        kernel_min = t2 - t1;                                 \
+    }                                                         \
+  } while (0)
+
+// ref vs. selected kernel in CPU cycles, the target (and QEMU) side of the host bench
+static void pixmath_bench(void)
+{
+  for (int i = 0; i < BENCH_MAT * BENCH_MAT; i++)
+  {
+    a16[i] = (int16_t)(i * 7919);
+    b16[i] = (int16_t)(i * 104729);
+    a8[i] = (int8_t)(i * 31);
+    b8[i] = (int8_t)(i * 17);
+  }
+  int errors = pm_selftest(42);
+  ESP_LOGI(TAG, "pixmath kernel=%s selftest %s (%d mismatches)", pm_kernel_name(), errors ? "FAILED" : "ok", errors);
+  if (errors)
+    return;
+
+  uint32_t ref, kernel;
+  for (int len = 16; len <= BENCH_MAT * BENCH_MAT; len *= 4)
+  {
+    BENCH_PAIR(sink = pm_ref_dot_s16(a16, b16, len), sink = pm_dot_s16(a16, b16, len), ref, kernel);
+    ESP_LOGI(TAG, "dot s16 len=%-4d ref=%8lu kernel=%8lu cycles %5.2fx", len, ref, kernel, (float)ref / kernel);
+    BENCH_PAIR(sink = pm_ref_dot_s8(a8, b8, len), sink = pm_dot_s8(a8, b8, len), ref, kernel);
+    ESP_LOGI(TAG, "dot s8  len=%-4d ref=%8lu kernel=%8lu cycles %5.2fx", len, ref, kernel, (float)ref / kernel);
+  }
+
+  // same shapes as the host bench: square matrices plus 64 pixels x 16 weights -> 3 channels
+  static const int shapes[][3] = {{16, 16, 16}, {32, 32, 32}, {64, 64, 64}, {64, 16, 3}};
+  for (int s = 0; s < (int)(sizeof(shapes) / sizeof(shapes[0])); s++)
+  {
+    int m = shapes[s][0], k = shapes[s][1], n = shapes[s][2];
+    BENCH_PAIR(pm_ref_matmul_s16(a16, b16, c16, m, k, n, 15), pm_matmul_s16(a16, b16, c16, m, k, n, 15), ref, kernel);
+    ESP_LOGI(TAG, "matmul s16 (%d,%d,%d) ref=%8lu kernel=%8lu cycles %5.2fx", m, k, n, ref, kernel, (float)ref / kernel);
+    BENCH_PAIR(pm_ref_matmul_s8(a8, b8, c16, m, k, n, 7), pm_matmul_s8(a8, b8, c16, m, k, n, 7), ref, kernel);
+    ESP_LOGI(TAG, "matmul s8  (%d,%d,%d) ref=%8lu kernel=%8lu cycles %5.2fx", m, k, n, ref, kernel, (float)ref / kernel);
+  }
+}
+
 void app_main(void)
 {
   srand(42);
@@ -66,13 +139,16 @@ void app_main(void)
       M3[i][j] = 0;
     }
   }
+  prof_row_claim = prof_register("matmul_claim");
+  prof_row = prof_register("matmul_row");
   int64_t start_time = esp_timer_get_time();
   row_mutex = xSemaphoreCreateMutex();
   sum_mutex = xSemaphoreCreateMutex();
   done_count_mul = xSemaphoreCreateCounting(2, 0);
 
-  xTaskCreatePinnedToCore(multiply_task, "multiply_task_A", 4096, NULL, 5, NULL, 0);
-  xTaskCreatePinnedToCore(multiply_task, "multiply_task_B", 4096, NULL, 5, NULL, 1);
+  // one worker per core, priority from the placement table
+  tp_create_on(TP_COMPUTE, 0, multiply_task, "multiply_task_A", 4096, NULL, NULL);
+  tp_create_on(TP_COMPUTE, 1, multiply_task, "multiply_task_B", 4096, NULL, NULL);
 
   xSemaphoreTake(done_count_mul, portMAX_DELAY);
   xSemaphoreTake(done_count_mul, portMAX_DELAY);
@@ -86,4 +162,6 @@ void app_main(void)
     }
   }
   ESP_LOGI(TAG, "Total sum = %d", sum);
+  prof_dump();
+  pixmath_bench();
 }
\ No newline at end of file
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/stream_buffer.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+#include "taskplace.h"
+
+#if CONFIG_WAKEBENCH_WIFI_LOAD
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "nvs_flash.h"
+#endif
+
+// Wake latency between two tasks for every FreeRTOS signalling primitive and core pair.
+//
+// The signaller wakes the waiter, the waiter wakes the signaller straight back, and the
+// signaller times the whole round trip on its own cycle counter (the two cores' counters
+// are not synchronized, so a one-way time can only be estimated as half the round trip).
+// The signaller runs at the network role's priority and the waiter at the show role's,
+// so the numbers describe "network task hands a message to the scheduler".
+
+static const char *TAG = "WAKE";
+
+#define SAMPLES CONFIG_WAKEBENCH_SAMPLES
+#define WARMUP 50
+
+typedef enum
+{
+  KIND_SEMAPHORE,
+  KIND_NOTIFY,
+  KIND_QUEUE,
+  KIND_STREAM,
+  KIND_COUNT
+} kind_t;
+
+static const char *kind_names[KIND_COUNT] = {"semaphore", "notify", "queue", "stream"};
+
+// direction 0 is signaller -> waiter, 1 is waiter -> signaller
+typedef struct
+{
+  kind_t kind;
+  SemaphoreHandle_t sem[2];
+  QueueHandle_t queue[2];
+  StreamBufferHandle_t stream[2];
+  TaskHandle_t task[2]; // task[d] receives direction d: [0] waiter, [1] signaller
+  SemaphoreHandle_t done;
+  uint32_t *samples;
+} channel_t;
+
+static void channel_send(channel_t *ch, int dir, uint32_t value)
+{
+  switch (ch->kind)
+  {
+  case KIND_SEMAPHORE:
+    xSemaphoreGive(ch->sem[dir]);
+    break;
+  case KIND_NOTIFY:
+    xTaskNotifyGive(ch->task[dir]);
+    break;
+  case KIND_QUEUE:
+    xQueueSend(ch->queue[dir], &value, portMAX_DELAY);
+    break;
+  case KIND_STREAM:
+    xStreamBufferSend(ch->stream[dir], &value, sizeof(value), portMAX_DELAY);
+    break;
+  default:
+    break;
+  }
+}
+
+static void channel_recv(channel_t *ch, int dir)
+{
+  uint32_t value;
+  switch (ch->kind)
+  {
+  case KIND_SEMAPHORE:
+    xSemaphoreTake(ch->sem[dir], portMAX_DELAY);
+    break;
+  case KIND_NOTIFY:
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    break;
+  case KIND_QUEUE:
+    xQueueReceive(ch->queue[dir], &value, portMAX_DELAY);
+    break;
+  case KIND_STREAM:
+    xStreamBufferReceive(ch->stream[dir], &value, sizeof(value), portMAX_DELAY);
+    break;
+  default:
+    break;
+  }
+}
+
+static void waiter_task(void *pvParameters)
+{
+  channel_t *ch = pvParameters;
+  for (int i = 0; i < WARMUP + SAMPLES; ++i)
+  {
+    channel_recv(ch, 0);
+    channel_send(ch, 1, i);
+  }
+  xSemaphoreGive(ch->done);
+  vTaskDelete(NULL);
+}
+
+static void signaller_task(void *pvParameters)
+{
+  channel_t *ch = pvParameters;
+  ch->task[1] = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < WARMUP + SAMPLES; ++i)
+  {
+    uint32_t start = esp_cpu_get_cycle_count();
+    channel_send(ch, 0, i);
+    channel_recv(ch, 1);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    if (i >= WARMUP)
+      ch->samples[i - WARMUP] = cycles;
+  }
+  xSemaphoreGive(ch->done);
+  vTaskDelete(NULL);
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void run_case(kind_t kind, int signal_core, int wait_core, const char *load, uint32_t *samples)
+{
+  static channel_t ch;
+  memset(&ch, 0, sizeof(ch));
+  ch.kind = kind;
+  ch.samples = samples;
+  ch.done = xSemaphoreCreateCounting(2, 0);
+  for (int d = 0; d < 2; ++d)
+  {
+    if (kind == KIND_SEMAPHORE)
+      ch.sem[d] = xSemaphoreCreateBinary();
+    else if (kind == KIND_QUEUE)
+      ch.queue[d] = xQueueCreate(1, sizeof(uint32_t));
+    else if (kind == KIND_STREAM)
+      ch.stream[d] = xStreamBufferCreate(16, sizeof(uint32_t));
+  }
+
+  // the waiter must exist (and be blocked) before the first signal
+  xTaskCreatePinnedToCore(waiter_task, "wake_wait", 3072, &ch, tp_get(TP_SHOW)->prio, &ch.task[0], wait_core);
+  vTaskDelay(1);
+  xTaskCreatePinnedToCore(signaller_task, "wake_signal", 3072, &ch, tp_get(TP_NET)->prio, NULL, signal_core);
+  xSemaphoreTake(ch.done, portMAX_DELAY);
+  xSemaphoreTake(ch.done, portMAX_DELAY);
+  vTaskDelay(1); // let the idle task reclaim both tasks
+
+  for (int d = 0; d < 2; ++d)
+  {
+    if (ch.sem[d])
+      vSemaphoreDelete(ch.sem[d]);
+    if (ch.queue[d])
+      vQueueDelete(ch.queue[d]);
+    if (ch.stream[d])
+      vStreamBufferDelete(ch.stream[d]);
+  }
+  vSemaphoreDelete(ch.done);
+
+  qsort(samples, SAMPLES, sizeof(uint32_t), cmp_u32);
+  uint64_t total = 0;
+  for (int i = 0; i < SAMPLES; ++i)
+    total += samples[i];
+  const float mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+  uint32_t p50 = samples[SAMPLES / 2];
+  uint32_t p99 = samples[SAMPLES * 99 / 100];
+  ESP_LOGI(TAG, "%-9s %d->%d %-4s rtt cycles min=%lu p50=%lu p99=%lu max=%lu mean=%lu | one-way p50=%.2fus p99=%.2fus max=%.2fus",
+           kind_names[kind], signal_core, wait_core, load, samples[0], p50, p99, samples[SAMPLES - 1],
+           (uint32_t)(total / SAMPLES), p50 / mhz / 2, p99 / mhz / 2, samples[SAMPLES - 1] / mhz / 2);
+}
+
+static void run_suite(const char *load, uint32_t *samples)
+{
+  // same core on both cores (core 0 also runs the Wi-Fi task), then both cross directions
+  static const int pairs[][2] = {{0, 0}, {1, 1}, {0, 1}, {1, 0}};
+  for (int p = 0; p < (int)(sizeof(pairs) / sizeof(pairs[0])); ++p)
+  {
+    if (pairs[p][0] >= portNUM_PROCESSORS || pairs[p][1] >= portNUM_PROCESSORS)
+      continue;
+    for (int k = 0; k < KIND_COUNT; ++k)
+      run_case(k, pairs[p][0], pairs[p][1], load, samples);
+  }
+}
+
+#if CONFIG_WAKEBENCH_WIFI_LOAD
+
+static EventGroupHandle_t wifi_event_group;
+#define WIFI_CONNECTED_BIT BIT0
+
+static volatile uint32_t traffic_bytes;
+
+static void wifi_event_handler(void *arg, esp_event_base_t event_base,
+                               int32_t event_id, void *event_data)
+{
+  if (event_base == WIFI_EVENT && (event_id == WIFI_EVENT_STA_START || event_id == WIFI_EVENT_STA_DISCONNECTED))
+    esp_wifi_connect();
+  else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
+}
+
+static void wifi_init_sta(void)
+{
+  esp_err_t ret = nvs_flash_init();
+  if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+  {
+    ESP_ERROR_CHECK(nvs_flash_erase());
+    ret = nvs_flash_init();
+  }
+  ESP_ERROR_CHECK(ret);
+  ESP_ERROR_CHECK(esp_netif_init());
+  wifi_event_group = xEventGroupCreate();
+  ESP_ERROR_CHECK(esp_event_loop_create_default());
+  esp_netif_create_default_wifi_sta();
+  ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL, NULL));
+  ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL, NULL));
+
+  wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+  ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+  wifi_config_t wifi_config = {
+      .sta = {
+          .ssid = CONFIG_WAKEBENCH_WIFI_SSID,
+          .password = CONFIG_WAKEBENCH_WIFI_PASSWORD,
+      },
+  };
+  ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+  ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+  ESP_ERROR_CHECK(esp_wifi_start());
+}
+
+// keeps the radio, lwIP and the Wi-Fi driver busy the way a chatty network task would
+static void traffic_task(void *pvParameters)
+{
+  static char payload[1024];
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  struct sockaddr_in dest_addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons(CONFIG_WAKEBENCH_TARGET_PORT),
+  };
+  inet_pton(AF_INET, CONFIG_WAKEBENCH_TARGET_IP, &dest_addr.sin_addr);
+  while (1)
+  {
+    int n = sendto(sock, payload, sizeof(payload), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+    if (n > 0)
+      traffic_bytes += n;
+    else
+      vTaskDelay(1); // out of buffers, let the driver drain
+  }
+}
+
+#endif
+
+void app_main(void)
+{
+  uint32_t *samples = malloc(SAMPLES * sizeof(uint32_t));
+  if (!samples)
+  {
+    ESP_LOGE(TAG, "no memory for %d samples", SAMPLES);
+    return;
+  }
+  tp_dump();
+  ESP_LOGI(TAG, "%d cores, %d MHz, %d round trips per case, signaller prio %u, waiter prio %u",
+           portNUM_PROCESSORS, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, SAMPLES,
+           tp_get(TP_NET)->prio, tp_get(TP_SHOW)->prio);
+
+  run_suite("idle", samples);
+
+#if CONFIG_WAKEBENCH_WIFI_LOAD
+  wifi_init_sta();
+  xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, false, true, portMAX_DELAY);
+  tp_create(TP_NET, traffic_task, "wake_traffic", 3072, NULL, NULL);
+  vTaskDelay(pdMS_TO_TICKS(1000)); // let the traffic reach a steady state
+  uint32_t bytes_before = traffic_bytes;
+  TickType_t ticks_before = xTaskGetTickCount();
+  run_suite("wifi", samples);
+  uint32_t ms = pdTICKS_TO_MS(xTaskGetTickCount() - ticks_before);
+  ESP_LOGI(TAG, "wifi load: %lu kB/s sent during the run", ms ? (traffic_bytes - bytes_before) / ms : 0);
+#endif
+
+  free(samples);
+  ESP_LOGI(TAG, "done");
+}
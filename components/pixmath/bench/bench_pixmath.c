@@ -0,0 +1,82 @@
+// Host check and benchmark for pixmath, not part of the firmware build.
+// gcc -O2 -I../include -o bench_pixmath ../pixmath.c bench_pixmath.c && ./bench_pixmath
+// On the target the same pm_selftest() runs at boot of ParallelMatrixMul (also under QEMU).
+#include <stdio.h>
+#include <time.h>
+#include "pixmath.h"
+
+#define MAX_LEN 4096
+#define MAX_MAT 64
+
+static int16_t a16[MAX_MAT * MAX_MAT] PM_ALIGNED;
+static int16_t b16[MAX_MAT * MAX_MAT] PM_ALIGNED;
+static int8_t a8[MAX_MAT * MAX_MAT] PM_ALIGNED;
+static int8_t b8[MAX_MAT * MAX_MAT] PM_ALIGNED;
+static int16_t c16[MAX_MAT * MAX_MAT];
+static volatile int32_t sink;
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// runs f until at least ~20 ms have passed, returns ns per call
+#define TIME_NS(expr)                                   \
+  ({                                                    \
+    long iters = 0;                                     \
+    double t0 = now_ns(), t1;                           \
+    do                                                  \
+    {                                                   \
+      for (int r_ = 0; r_ < 64; ++r_)                   \
+        expr;                                           \
+      iters += 64;                                      \
+      t1 = now_ns();                                    \
+    } while (t1 - t0 < 20e6);                           \
+    (t1 - t0) / iters;                                  \
+  })
+
+int main(void)
+{
+  int errors = pm_selftest(12345);
+  printf("kernel: %s, selftest %s (%d mismatches)\n", pm_kernel_name(), errors ? "FAILED" : "ok", errors);
+  if (errors)
+    return 1;
+
+  for (int i = 0; i < MAX_MAT * MAX_MAT; ++i)
+  {
+    a16[i] = (int16_t)(i * 7919);
+    b16[i] = (int16_t)(i * 104729);
+    a8[i] = (int8_t)(i * 31);
+    b8[i] = (int8_t)(i * 17);
+  }
+
+  printf("\n%-22s %12s %12s %8s\n", "dot", "ref ns", "kernel ns", "speedup");
+  for (int len = 16; len <= MAX_LEN; len *= 4)
+  {
+    double r = TIME_NS(sink = pm_ref_dot_s16(a16, b16, len));
+    double k = TIME_NS(sink = pm_dot_s16(a16, b16, len));
+    printf("s16 len=%-14d %12.1f %12.1f %7.2fx\n", len, r, k, r / k);
+    r = TIME_NS(sink = pm_ref_dot_s8(a8, b8, len));
+    k = TIME_NS(sink = pm_dot_s8(a8, b8, len));
+    printf("s8  len=%-14d %12.1f %12.1f %7.2fx\n", len, r, k, r / k);
+  }
+
+  // square matrices plus the colour-mixing shape: 64 pixels x 16 weights -> 3 channels
+  static const int shapes[][3] = {{16, 16, 16}, {32, 32, 32}, {64, 64, 64}, {64, 16, 3}};
+  printf("\n%-22s %12s %12s %8s\n", "matmul (m,k,n)", "ref ns", "kernel ns", "speedup");
+  for (unsigned s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s)
+  {
+    int m = shapes[s][0], k = shapes[s][1], n = shapes[s][2];
+    char shape[24];
+    snprintf(shape, sizeof(shape), "(%d,%d,%d)", m, k, n);
+    double r = TIME_NS(pm_ref_matmul_s16(a16, b16, c16, m, k, n, 15));
+    double kn = TIME_NS(pm_matmul_s16(a16, b16, c16, m, k, n, 15));
+    printf("s16 %-18s %12.1f %12.1f %7.2fx\n", shape, r, kn, r / kn);
+    r = TIME_NS(pm_ref_matmul_s8(a8, b8, c16, m, k, n, 7));
+    kn = TIME_NS(pm_matmul_s8(a8, b8, c16, m, k, n, 7));
+    printf("s8  %-18s %12.1f %12.1f %7.2fx\n", shape, r, kn, r / kn);
+  }
+  return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+// Small-integer dot-product and matrix kernels for per-pixel colour / brightness work.
+//
+// The kernel is picked at compile time: with CONFIG_PIXMATH_PIE (ESP32-S3 only, off by default
+// until verified on hardware) the bulk of every row runs on the PIE vector unit (128-bit loads,
+// 16 x int8 or 8 x int16 MACs per instruction into the 40-bit ACCX accumulator), everywhere
+// else an unrolled scalar loop.
+// Both must give exactly the pm_ref_* results, pm_selftest() checks that on the target.
+//
+// Vector path requirements: both operand rows 16-byte aligned (use PM_ALIGNED), and for
+// the matrix kernels a row stride (k * element size) that is a multiple of 16 bytes.
+// Anything else silently takes the scalar path, so results never depend on alignment.
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#if defined(CONFIG_PIXMATH_PIE) && !defined(PM_FORCE_SCALAR)
+#define PM_HAVE_PIE 1
+#else
+#define PM_HAVE_PIE 0
+#endif
+
+#define PM_ALIGNED __attribute__((aligned(16)))
+
+// sum(a[i] * b[i]), computed exactly and saturated to int32
+int32_t pm_dot_s8(const int8_t *a, const int8_t *b, int len);
+int32_t pm_dot_s16(const int16_t *a, const int16_t *b, int len);
+
+// c[i][j] = sat16((sum_k a[i][k] * bt[j][k] + round) >> shift), shift in 0..31.
+// bt is the right-hand matrix transposed (n rows of k) so every output is one dot product.
+// round is 1 << (shift - 1) for shift > 0 (round half up).
+void pm_matmul_s8(const int8_t *a, const int8_t *bt, int16_t *c, int m, int k, int n, int shift);
+void pm_matmul_s16(const int16_t *a, const int16_t *bt, int16_t *c, int m, int k, int n, int shift);
+
+// plain reference definitions of the results above
+int32_t pm_ref_dot_s8(const int8_t *a, const int8_t *b, int len);
+int32_t pm_ref_dot_s16(const int16_t *a, const int16_t *b, int len);
+void pm_ref_matmul_s8(const int8_t *a, const int8_t *bt, int16_t *c, int m, int k, int n, int shift);
+void pm_ref_matmul_s16(const int16_t *a, const int16_t *bt, int16_t *c, int m, int k, int n, int shift);
+
+// "pie" or "scalar"
+const char *pm_kernel_name(void);
+
+// randomized bit-exact comparison against the reference over many sizes and alignments,
+// returns the number of mismatching results (0 = pass)
+int pm_selftest(uint32_t seed);
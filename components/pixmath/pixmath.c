@@ -0,0 +1,339 @@
+#include <stddef.h>
+#include "pixmath.h"
+
+// ---- reference ------------------------------------------------------------
+
+static int32_t sat32(int64_t v)
+{
+  if (v > INT32_MAX)
+    return INT32_MAX;
+  if (v < INT32_MIN)
+    return INT32_MIN;
+  return (int32_t)v;
+}
+
+static int16_t requant16(int64_t acc, int shift)
+{
+  if (shift > 0)
+    acc = (acc + ((int64_t)1 << (shift - 1))) >> shift;
+  if (acc > INT16_MAX)
+    return INT16_MAX;
+  if (acc < INT16_MIN)
+    return INT16_MIN;
+  return (int16_t)acc;
+}
+
+static int64_t ref_dot64_s8(const int8_t *a, const int8_t *b, int len)
+{
+  int64_t acc = 0;
+  for (int i = 0; i < len; ++i)
+    acc += (int32_t)a[i] * b[i];
+  return acc;
+}
+
+static int64_t ref_dot64_s16(const int16_t *a, const int16_t *b, int len)
+{
+  int64_t acc = 0;
+  for (int i = 0; i < len; ++i)
+    acc += (int32_t)a[i] * b[i];
+  return acc;
+}
+
+int32_t pm_ref_dot_s8(const int8_t *a, const int8_t *b, int len)
+{
+  return sat32(ref_dot64_s8(a, b, len));
+}
+
+int32_t pm_ref_dot_s16(const int16_t *a, const int16_t *b, int len)
+{
+  return sat32(ref_dot64_s16(a, b, len));
+}
+
+void pm_ref_matmul_s8(const int8_t *a, const int8_t *bt, int16_t *c, int m, int k, int n, int shift)
+{
+  for (int i = 0; i < m; ++i)
+    for (int j = 0; j < n; ++j)
+      c[i * n + j] = requant16(ref_dot64_s8(&a[i * k], &bt[j * k], k), shift);
+}
+
+void pm_ref_matmul_s16(const int16_t *a, const int16_t *bt, int16_t *c, int m, int k, int n, int shift)
+{
+  for (int i = 0; i < m; ++i)
+    for (int j = 0; j < n; ++j)
+      c[i * n + j] = requant16(ref_dot64_s16(&a[i * k], &bt[j * k], k), shift);
+}
+
+// ---- scalar ---------------------------------------------------------------
+
+// |a*b| <= 2^14 for int8, so 2^16 products always fit an int32 accumulator
+#define S8_CHUNK 65536
+
+static int64_t scalar_dot64_s8(const int8_t *a, const int8_t *b, int len)
+{
+  int64_t total = 0;
+  while (len > 0)
+  {
+    int n = (len < S8_CHUNK) ? len : S8_CHUNK;
+    int32_t acc0 = 0, acc1 = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      acc0 += (int32_t)a[i] * b[i] + (int32_t)a[i + 1] * b[i + 1];
+      acc1 += (int32_t)a[i + 2] * b[i + 2] + (int32_t)a[i + 3] * b[i + 3];
+    }
+    for (; i < n; ++i)
+      acc0 += (int32_t)a[i] * b[i];
+    total += (int64_t)acc0 + acc1;
+    a += n;
+    b += n;
+    len -= n;
+  }
+  return total;
+}
+
+static int64_t scalar_dot64_s16(const int16_t *a, const int16_t *b, int len)
+{
+  // one int16 product can already be 2^30, so partial sums stay 64-bit
+  int64_t acc0 = 0, acc1 = 0;
+  int i = 0;
+  for (; i + 4 <= len; i += 4)
+  {
+    acc0 += (int32_t)a[i] * b[i];
+    acc1 += (int32_t)a[i + 1] * b[i + 1];
+    acc0 += (int32_t)a[i + 2] * b[i + 2];
+    acc1 += (int32_t)a[i + 3] * b[i + 3];
+  }
+  for (; i < len; ++i)
+    acc0 += (int32_t)a[i] * b[i];
+  return acc0 + acc1;
+}
+
+// ---- ESP32-S3 PIE ---------------------------------------------------------
+
+#if PM_HAVE_PIE
+
+// ACCX is 40 bits: 2^12 blocks of 16 int8 products (<= 2^14 each) or 2^5 blocks of
+// 8 int16 products (<= 2^30 each) can never overflow it
+#define PIE_S8_CHUNK_BLOCKS 4096
+#define PIE_S16_CHUNK_BLOCKS 32
+
+static inline int64_t accx_value(uint32_t lo, uint32_t hi)
+{
+  // ACCX_1 holds bits 32..39, sign-extend them
+  return (int64_t)(((uint64_t)(int64_t)(int8_t)hi << 32) | lo);
+}
+
+// blocks >= 1, a and b 16-byte aligned
+static int64_t pie_blocks_s8(const int8_t *a, const int8_t *b, int blocks)
+{
+  uint32_t lo, hi;
+  __asm__ volatile(
+      "ee.zero.accx\n"
+      "1:\n"
+      "ee.vld.128.ip q0, %[a], 16\n"
+      "ee.vld.128.ip q1, %[b], 16\n"
+      "addi %[n], %[n], -1\n"
+      "ee.vmulas.s8.accx q0, q1\n"
+      "bnez %[n], 1b\n"
+      "rur.accx_0 %[lo]\n"
+      "rur.accx_1 %[hi]\n"
+      : [a] "+r"(a), [b] "+r"(b), [n] "+r"(blocks), [lo] "=r"(lo), [hi] "=r"(hi)
+      :
+      : "memory");
+  return accx_value(lo, hi);
+}
+
+static int64_t pie_blocks_s16(const int16_t *a, const int16_t *b, int blocks)
+{
+  uint32_t lo, hi;
+  __asm__ volatile(
+      "ee.zero.accx\n"
+      "1:\n"
+      "ee.vld.128.ip q0, %[a], 16\n"
+      "ee.vld.128.ip q1, %[b], 16\n"
+      "addi %[n], %[n], -1\n"
+      "ee.vmulas.s16.accx q0, q1\n"
+      "bnez %[n], 1b\n"
+      "rur.accx_0 %[lo]\n"
+      "rur.accx_1 %[hi]\n"
+      : [a] "+r"(a), [b] "+r"(b), [n] "+r"(blocks), [lo] "=r"(lo), [hi] "=r"(hi)
+      :
+      : "memory");
+  return accx_value(lo, hi);
+}
+
+static inline int aligned16(const void *p)
+{
+  return ((uintptr_t)p & 15) == 0;
+}
+
+static int64_t dot64_s8(const int8_t *a, const int8_t *b, int len)
+{
+  if (!aligned16(a) || !aligned16(b))
+    return scalar_dot64_s8(a, b, len);
+  int64_t total = 0;
+  int blocks = len / 16;
+  while (blocks > 0)
+  {
+    int n = (blocks < PIE_S8_CHUNK_BLOCKS) ? blocks : PIE_S8_CHUNK_BLOCKS;
+    total += pie_blocks_s8(a, b, n);
+    a += n * 16;
+    b += n * 16;
+    blocks -= n;
+  }
+  return total + scalar_dot64_s8(a, b, len % 16);
+}
+
+static int64_t dot64_s16(const int16_t *a, const int16_t *b, int len)
+{
+  if (!aligned16(a) || !aligned16(b))
+    return scalar_dot64_s16(a, b, len);
+  int64_t total = 0;
+  int blocks = len / 8;
+  while (blocks > 0)
+  {
+    int n = (blocks < PIE_S16_CHUNK_BLOCKS) ? blocks : PIE_S16_CHUNK_BLOCKS;
+    total += pie_blocks_s16(a, b, n);
+    a += n * 8;
+    b += n * 8;
+    blocks -= n;
+  }
+  return total + scalar_dot64_s16(a, b, len % 8);
+}
+
+#else
+
+#define dot64_s8 scalar_dot64_s8
+#define dot64_s16 scalar_dot64_s16
+
+#endif
+
+// ---- public kernels -------------------------------------------------------
+
+int32_t pm_dot_s8(const int8_t *a, const int8_t *b, int len)
+{
+  return sat32(dot64_s8(a, b, len));
+}
+
+int32_t pm_dot_s16(const int16_t *a, const int16_t *b, int len)
+{
+  return sat32(dot64_s16(a, b, len));
+}
+
+void pm_matmul_s8(const int8_t *a, const int8_t *bt, int16_t *c, int m, int k, int n, int shift)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    const int8_t *row = &a[i * k];
+    for (int j = 0; j < n; ++j)
+      *c++ = requant16(dot64_s8(row, &bt[j * k], k), shift);
+  }
+}
+
+void pm_matmul_s16(const int16_t *a, const int16_t *bt, int16_t *c, int m, int k, int n, int shift)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    const int16_t *row = &a[i * k];
+    for (int j = 0; j < n; ++j)
+      *c++ = requant16(dot64_s16(row, &bt[j * k], k), shift);
+  }
+}
+
+const char *pm_kernel_name(void)
+{
+  return PM_HAVE_PIE ? "pie" : "scalar";
+}
+
+// ---- self test ------------------------------------------------------------
+
+#define TEST_MAX_LEN 1024
+#define TEST_MAX_MAT 24
+
+static uint32_t rng_state;
+
+static uint32_t rng(void)
+{
+  // xorshift32
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+// mostly random values, with a good share of the extremes that stress saturation
+static int8_t rand_s8(void)
+{
+  uint32_t r = rng();
+  switch (r & 7)
+  {
+  case 0:
+    return INT8_MIN;
+  case 1:
+    return INT8_MAX;
+  default:
+    return (int8_t)(r >> 8);
+  }
+}
+
+static int16_t rand_s16(void)
+{
+  uint32_t r = rng();
+  switch (r & 7)
+  {
+  case 0:
+    return INT16_MIN;
+  case 1:
+    return INT16_MAX;
+  default:
+    return (int16_t)(r >> 8);
+  }
+}
+
+int pm_selftest(uint32_t seed)
+{
+  static int16_t a16[TEST_MAX_LEN + 8] PM_ALIGNED;
+  static int16_t b16[TEST_MAX_LEN + 8] PM_ALIGNED;
+  static int8_t a8[TEST_MAX_LEN + 16] PM_ALIGNED;
+  static int8_t b8[TEST_MAX_LEN + 16] PM_ALIGNED;
+  static int16_t c_ref[TEST_MAX_MAT * TEST_MAX_MAT];
+  static int16_t c_out[TEST_MAX_MAT * TEST_MAX_MAT];
+  int errors = 0;
+
+  rng_state = seed ? seed : 1;
+  for (int round = 0; round < 200; ++round)
+  {
+    for (int i = 0; i < TEST_MAX_LEN + 8; ++i)
+    {
+      a16[i] = rand_s16();
+      b16[i] = rand_s16();
+    }
+    for (int i = 0; i < TEST_MAX_LEN + 16; ++i)
+    {
+      a8[i] = rand_s8();
+      b8[i] = rand_s8();
+    }
+
+    // dot products: every length class, aligned and misaligned starts
+    int len = rng() % (TEST_MAX_LEN + 1);
+    int off = (round & 1) ? 0 : (int)(rng() % 8);
+    errors += pm_dot_s16(a16 + off, b16 + off, len) != pm_ref_dot_s16(a16 + off, b16 + off, len);
+    off = (round & 1) ? 0 : (int)(rng() % 16);
+    errors += pm_dot_s8(a8 + off, b8 + off, len) != pm_ref_dot_s8(a8 + off, b8 + off, len);
+
+    // matrices: k a multiple of 16 half of the time so the vector path is used for every row
+    int m = 1 + rng() % TEST_MAX_MAT;
+    int n = 1 + rng() % TEST_MAX_MAT;
+    int k = (round & 2) ? 16 * (1 + rng() % 2) : 1 + rng() % 24;
+    int shift = rng() % 24;
+    pm_ref_matmul_s16(a16, b16, c_ref, m, k, n, shift);
+    pm_matmul_s16(a16, b16, c_out, m, k, n, shift);
+    for (int i = 0; i < m * n; ++i)
+      errors += c_ref[i] != c_out[i];
+    pm_ref_matmul_s8(a8, b8, c_ref, m, k, n, shift);
+    pm_matmul_s8(a8, b8, c_out, m, k, n, shift);
+    for (int i = 0; i < m * n; ++i)
+      errors += c_ref[i] != c_out[i];
+  }
+  return errors;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+
+// Lightweight section profiler on the CPU cycle counter.
+//
+//   static int sec_row;
+//   sec_row = prof_register("matmul_row");   // once, at init
+//   ...
+//   {
+//     PROF_SCOPE(sec_row);                    // measured until the end of this block
+//     ...
+//   }
+//
+// Samples are kept per core in fixed storage (count / min / mean / max and a log2
+// histogram), nothing is printed while measuring. Call prof_dump() or prof_format_json()
+// when the timing-critical part is over.
+
+#define PROF_BUCKETS 24 // bucket b = [2^b, 2^(b+1)) cycles, the last one is open-ended
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t dropped; // begin and end ran on different cores, cycle counters not comparable
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+  uint32_t hist[PROF_BUCKETS];
+} prof_stats_t;
+
+typedef struct
+{
+  uint32_t cycles;
+  int core;
+} prof_mark_t;
+
+#if CONFIG_PROFILER_ENABLE
+
+static inline prof_mark_t prof_begin(void)
+{
+  prof_mark_t mark;
+  // core and counter must come from the same core: no preemption (and migration) in between
+  UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+  mark.core = esp_cpu_get_core_id();
+  mark.cycles = esp_cpu_get_cycle_count();
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+  return mark;
+}
+
+// returns the section id (same id for the same name), -1 when the table is full
+int prof_register(const char *name);
+void prof_end(int section, prof_mark_t mark);
+
+typedef struct
+{
+  int section;
+  prof_mark_t mark;
+} prof_scope_t;
+
+static inline void prof_scope_exit(prof_scope_t *scope)
+{
+  prof_end(scope->section, scope->mark);
+}
+
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+#define PROF_BEGIN(mark) prof_mark_t mark = prof_begin()
+#define PROF_END(section, mark) prof_end((section), (mark))
+#define PROF_SCOPE(section)                                                                              \
+  prof_scope_t PROF_CONCAT(prof_scope_, __LINE__) __attribute__((cleanup(prof_scope_exit), unused)) = { \
+      (section), prof_begin()}
+
+#else
+
+static inline int prof_register(const char *name)
+{
+  return -1;
+}
+
+#define PROF_BEGIN(mark)
+#define PROF_END(section, mark)
+#define PROF_SCOPE(section)
+
+#endif
+
+// copy of one section's statistics on one core, 0 if there is no such section
+int prof_get(int core, int section, prof_stats_t *out);
+void prof_reset(void);
+// one ESP_LOGI line per section and core, plus the histogram
+void prof_dump(void);
+// {"type":"prof","mhz":..,"sections":[{"name":..,"core":..,"n":..,"min":..,"mean":..,"max":..,"hist":[..]}]}
+// returns the length written (without the terminator), or -1 if buf was too small
+int prof_format_json(char *buf, size_t len);
@@ -0,0 +1,199 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "profiler.h"
+
+static const char *TAG = "PROF";
+
+#if CONFIG_PROFILER_ENABLE
+
+#define PROF_MAX_SECTIONS CONFIG_PROFILER_MAX_SECTIONS
+
+static const char *section_names[PROF_MAX_SECTIONS];
+static int section_count = 0;
+static portMUX_TYPE register_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// each core only ever writes its own row, so no cross-core locking on the hot path
+static prof_stats_t stats[portNUM_PROCESSORS][PROF_MAX_SECTIONS];
+
+static void stats_clear(prof_stats_t *s)
+{
+  memset(s, 0, sizeof(*s));
+  s->min = UINT32_MAX;
+}
+
+int prof_register(const char *name)
+{
+  int id = -1;
+  taskENTER_CRITICAL(&register_lock);
+  for (int i = 0; i < section_count; ++i)
+  {
+    if (strcmp(section_names[i], name) == 0)
+    {
+      id = i;
+      break;
+    }
+  }
+  if (id < 0 && section_count < PROF_MAX_SECTIONS)
+  {
+    id = section_count++;
+    section_names[id] = name;
+    for (int core = 0; core < portNUM_PROCESSORS; ++core)
+      stats_clear(&stats[core][id]);
+  }
+  taskEXIT_CRITICAL(&register_lock);
+  if (id < 0)
+    ESP_LOGW(TAG, "no room for section %s", name);
+  return id;
+}
+
+void prof_end(int section, prof_mark_t mark)
+{
+  if (section < 0 || section >= section_count)
+    return;
+
+  // mask first, then read counter and core: with interrupts off the task cannot be moved to
+  // the other core, so both readings are from this core and nothing else writes stats[core]
+  UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+  uint32_t now = esp_cpu_get_cycle_count();
+  int core = esp_cpu_get_core_id();
+  uint32_t cycles = now - mark.cycles; // unsigned math survives counter wrap
+  prof_stats_t *s = &stats[core][section];
+  if (core != mark.core)
+  {
+    s->dropped++;
+  }
+  else
+  {
+    int bucket = (cycles > 1) ? 31 - __builtin_clz(cycles) : 0;
+    if (bucket >= PROF_BUCKETS)
+      bucket = PROF_BUCKETS - 1;
+    s->count++;
+    s->total += cycles;
+    if (cycles < s->min)
+      s->min = cycles;
+    if (cycles > s->max)
+      s->max = cycles;
+    s->hist[bucket]++;
+  }
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+}
+
+int prof_get(int core, int section, prof_stats_t *out)
+{
+  if (core < 0 || core >= portNUM_PROCESSORS || section < 0 || section >= section_count)
+    return 0;
+  // the owning core may be mid-update; a reader on another core can see one sample torn
+  *out = stats[core][section];
+  return 1;
+}
+
+void prof_reset(void)
+{
+  for (int core = 0; core < portNUM_PROCESSORS; ++core)
+  {
+    for (int i = 0; i < section_count; ++i)
+    {
+      // same masking as prof_end() for our own core, the other core's row may race once
+      UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+      stats_clear(&stats[core][i]);
+      portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+    }
+  }
+}
+
+void prof_dump(void)
+{
+  const int mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+  for (int i = 0; i < section_count; ++i)
+  {
+    for (int core = 0; core < portNUM_PROCESSORS; ++core)
+    {
+      prof_stats_t s;
+      prof_get(core, i, &s);
+      if (s.count == 0 && s.dropped == 0)
+        continue;
+      uint32_t mean = s.count ? (uint32_t)(s.total / s.count) : 0;
+      ESP_LOGI(TAG, "%-16s core%d n=%lu min=%lu mean=%lu max=%lu cycles (max %lu us) dropped=%lu",
+               section_names[i], core, s.count, s.count ? s.min : 0, mean, s.max, s.max / mhz, s.dropped);
+
+      // worst case " 2^23:4294967295" is 16 characters per bucket
+      char line[PROF_BUCKETS * 17] = "";
+      size_t n = 0;
+      for (int b = 0; b < PROF_BUCKETS && n < sizeof(line); ++b)
+      {
+        if (s.hist[b])
+          n += snprintf(line + n, sizeof(line) - n, " 2^%d:%lu", b, s.hist[b]);
+      }
+      ESP_LOGI(TAG, "%-16s core%d hist%s", section_names[i], core, line);
+    }
+  }
+}
+
+int prof_format_json(char *buf, size_t len)
+{
+  size_t n = 0;
+#define PROF_APPEND(...)                                    \
+  do                                                        \
+  {                                                         \
+    int w = snprintf(buf + n, len - n, __VA_ARGS__);        \
+    if (w < 0 || (size_t)w >= len - n)                      \
+      return -1;                                            \
+    n += w;                                                 \
+  } while (0)
+
+  if (len == 0)
+    return -1;
+  PROF_APPEND("{\"type\":\"prof\",\"mhz\":%d,\"sections\":[", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+  bool first = true;
+  for (int i = 0; i < section_count; ++i)
+  {
+    for (int core = 0; core < portNUM_PROCESSORS; ++core)
+    {
+      prof_stats_t s;
+      prof_get(core, i, &s);
+      if (s.count == 0 && s.dropped == 0)
+        continue;
+      PROF_APPEND("%s{\"name\":\"%s\",\"core\":%d,\"n\":%lu,\"dropped\":%lu,\"min\":%lu,\"mean\":%lu,\"max\":%lu,\"hist\":[",
+                  first ? "" : ",", section_names[i], core, s.count, s.dropped, s.count ? s.min : 0,
+                  s.count ? (uint32_t)(s.total / s.count) : 0, s.max);
+      first = false;
+      // trailing empty buckets are left out
+      int last = PROF_BUCKETS - 1;
+      while (last > 0 && s.hist[last] == 0)
+        last--;
+      for (int b = 0; b <= last; ++b)
+        PROF_APPEND("%s%lu", b ? "," : "", s.hist[b]);
+      PROF_APPEND("]}");
+    }
+  }
+  PROF_APPEND("]}");
+#undef PROF_APPEND
+  return (int)n;
+}
+
+#else
+
+int prof_get(int core, int section, prof_stats_t *out)
+{
+  return 0;
+}
+
+void prof_reset(void)
+{
+}
+
+void prof_dump(void)
+{
+  ESP_LOGI(TAG, "profiler disabled (CONFIG_PROFILER_ENABLE)");
+}
+
+int prof_format_json(char *buf, size_t len)
+{
+  return snprintf(buf, len, "{\"type\":\"prof\",\"sections\":[]}");
+}
+
+#endif
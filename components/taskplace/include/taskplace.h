@@ -0,0 +1,41 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// One table that decides on which core and at which priority every firmware task runs.
+//
+//   tp_create(TP_NET, net_task, "net", 6144, NULL, NULL);
+//
+// Core and priority of each role come from menuconfig ("Task placement"), so moving the
+// network or the show scheduler to the other core is a config change, not a code change.
+// Use WakeLatency/ to measure what a placement costs before changing the defaults.
+
+typedef enum
+{
+  TP_NET,     // sockets, protocol handling
+  TP_SHOW,    // timed cue execution, the timing-critical path
+  TP_RENDER,  // LED / matrix output
+  TP_COMPUTE, // number crunching workers
+  TP_ROLE_COUNT
+} tp_role_t;
+
+typedef struct
+{
+  const char *name;
+  BaseType_t core; // tskNO_AFFINITY when not pinned
+  UBaseType_t prio;
+} tp_placement_t;
+
+const tp_placement_t *tp_get(tp_role_t role);
+
+// xTaskCreatePinnedToCore() with the role's core and priority, returns pdPASS on success
+BaseType_t tp_create(tp_role_t role, TaskFunction_t fn, const char *name, uint32_t stack,
+                     void *arg, TaskHandle_t *handle);
+
+// same with an explicit core (e.g. one worker per core), core >= cores means unpinned
+BaseType_t tp_create_on(tp_role_t role, BaseType_t core, TaskFunction_t fn, const char *name,
+                        uint32_t stack, void *arg, TaskHandle_t *handle);
+
+// logs the placement table
+void tp_dump(void);
@@ -0,0 +1,49 @@
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "taskplace.h"
+
+static const char *TAG = "PLACE";
+
+// Kconfig uses -1 for "either core"
+#define TP_CORE(c) (((c) < 0 || (c) >= portNUM_PROCESSORS) ? tskNO_AFFINITY : (BaseType_t)(c))
+
+static const tp_placement_t table[TP_ROLE_COUNT] = {
+    [TP_NET] = {"net", TP_CORE(CONFIG_TASKPLACE_NET_CORE), CONFIG_TASKPLACE_NET_PRIO},
+    [TP_SHOW] = {"show", TP_CORE(CONFIG_TASKPLACE_SHOW_CORE), CONFIG_TASKPLACE_SHOW_PRIO},
+    [TP_RENDER] = {"render", TP_CORE(CONFIG_TASKPLACE_RENDER_CORE), CONFIG_TASKPLACE_RENDER_PRIO},
+    [TP_COMPUTE] = {"compute", TP_CORE(CONFIG_TASKPLACE_COMPUTE_CORE), CONFIG_TASKPLACE_COMPUTE_PRIO},
+};
+
+const tp_placement_t *tp_get(tp_role_t role)
+{
+  return &table[role];
+}
+
+BaseType_t tp_create_on(tp_role_t role, BaseType_t core, TaskFunction_t fn, const char *name,
+                        uint32_t stack, void *arg, TaskHandle_t *handle)
+{
+  if (core < 0 || core >= portNUM_PROCESSORS)
+    core = tskNO_AFFINITY;
+  BaseType_t ok = xTaskCreatePinnedToCore(fn, name, stack, arg, table[role].prio, handle, core);
+  if (ok != pdPASS)
+    ESP_LOGE(TAG, "failed to create %s (%s)", name, table[role].name);
+  return ok;
+}
+
+BaseType_t tp_create(tp_role_t role, TaskFunction_t fn, const char *name, uint32_t stack,
+                     void *arg, TaskHandle_t *handle)
+{
+  return tp_create_on(role, table[role].core, fn, name, stack, arg, handle);
+}
+
+void tp_dump(void)
+{
+  for (int i = 0; i < TP_ROLE_COUNT; ++i)
+  {
+    if (table[i].core == tskNO_AFFINITY)
+      ESP_LOGI(TAG, "%-8s core any prio %u", table[i].name, table[i].prio);
+    else
+      ESP_LOGI(TAG, "%-8s core %d   prio %u", table[i].name, table[i].core, table[i].prio);
+  }
+}
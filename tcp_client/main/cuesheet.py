@@ -0,0 +1,76 @@
+import json
+
+# must match show_effect_t in show.h
+EFFECTS = {"off": 0, "on": 1, "fade": 2}
+
+# must match SHOW_MAX_CUES in show.h
+MAX_CUES = 512
+
+# cues per "sched" message, keeps every line well below the device's 2048-byte line buffer
+CUES_PER_PART = 48
+
+
+def load_cue_sheet(path):
+    """
+    Cue sheet format:
+    {
+      "devices": {"A": "192.168.0.12", "B": "192.168.0.13"},   # optional names -> IP
+      "cues": [
+        {"t": 1.5, "target": "all", "effect": "on", "value": 255},
+        {"t": 3.0, "target": ["A"], "effect": "fade", "value": 0, "ms": 500}
+      ]
+    }
+    "t" is seconds from the show start, "target" is "all", a name, an IP or a list of them.
+    """
+    with open(path) as f:
+        return json.load(f)
+
+
+def compile_cue_sheet(sheet, connected_ips):
+    """Returns {ip: [[t_us, effect, value, dur_ms], ...]} sorted by time for every targeted device."""
+    names = sheet.get("devices", {})
+    all_ips = sorted(set(names.values()) | set(connected_ips))
+    schedules = {ip: [] for ip in all_ips}
+
+    for i, cue in enumerate(sheet.get("cues", [])):
+        effect = cue.get("effect")
+        if effect not in EFFECTS:
+            raise ValueError(f"cue {i}: unknown effect {effect!r}")
+        t_us = int(round(float(cue["t"]) * 1_000_000))
+        if t_us < 0:
+            raise ValueError(f"cue {i}: negative time")
+        value = int(cue.get("value", 255 if effect == "on" else 0))
+        dur_ms = int(cue.get("ms", 0))
+        if not 0 <= value <= 255 or not 0 <= dur_ms <= 0xFFFF:
+            raise ValueError(f"cue {i}: value or ms out of range")
+
+        targets = cue.get("target", "all")
+        if isinstance(targets, str):
+            targets = [targets]
+        ips = set()
+        for target in targets:
+            if target == "all":
+                ips.update(all_ips)
+            else:
+                ips.add(names.get(target, target))
+        for ip in ips:
+            schedules.setdefault(ip, []).append(
+                [t_us, EFFECTS[effect], value, dur_ms])
+
+    for ip, cues in schedules.items():
+        if len(cues) > MAX_CUES:
+            raise ValueError(f"{ip}: {len(cues)} cues, device holds {MAX_CUES}")
+        cues.sort(key=lambda c: c[0])  # stable, so same-time cues keep sheet order
+    return schedules
+
+
+def schedule_messages(cues):
+    """Splits one device's schedule into the "sched" messages the firmware expects."""
+    parts = max(1, (len(cues) + CUES_PER_PART - 1) // CUES_PER_PART)
+    for part in range(parts):
+        yield {
+            "type": "sched",
+            "part": part,
+            "parts": parts,
+            "cues": cues[part * CUES_PER_PART:(part + 1) * CUES_PER_PART],
+        }
@@ -1,9 +1,5 @@
 #include <stdio.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <netdb.h>
-#include <arpa/inet.h>
-#include <unistd.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -14,156 +10,163 @@
 #include "esp_netif.h"
 #include "cJSON.h"
 #include "esp_timer.h"
+#include "show.h"
+#include "net.h"
+#include "profiler.h"
+#include "taskplace.h"
 
-#define SERVER_IP "192.168.0.138" // server IP
-#define SERVER_PORT 5000
-
-int64_t offset = 0;
 static const char *TAG = "TCP_CLIENT"; // tag for esplog (you will see when you monitor)
+static int prof_decode;
 
-void tcp_client_task(void *pvParameters)
+// deal with one message from the server (a TCP line or a UDP command datagram), runs on the net task
+static void handle_message(const char *line)
 {
-  char rx_buffer[1024];
-  struct sockaddr_in dest_addr; // the struct with (sin.family, sin.port, sin.addr) inside, for communication
-
-  // build a TCP socket
-  int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
-  if (sock < 0)
+  // debug only: console output blocks the net task, a 2 KB sched part would stall select() for ~175 ms
+  ESP_LOGD(TAG, "Received from server: %s", line);
+  // deal with the command
+  PROF_BEGIN(decode_start);
+  cJSON *root = cJSON_Parse(line);
+  PROF_END(prof_decode, decode_start);
+  if (!root)
   {
-    ESP_LOGE(TAG, "Unable to create socket: errno %d", errno); // errno: global variable to save the last error code
-    vTaskDelete(NULL);
+    ESP_LOGE(TAG, "fail to parse json file");
     return;
   }
-
-  // assign value for dest_addr
-  dest_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
-  dest_addr.sin_family = AF_INET;
-  dest_addr.sin_port = htons(SERVER_PORT);
-
-  // to build a connection, if success return 0
-  ESP_LOGI(TAG, "Connecting to %s:%d...", SERVER_IP, SERVER_PORT);
-  int err = connect(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-  if (err != 0)
+  cJSON *type = cJSON_GetObjectItem(root, "type");
+  // "play" should be handled as a command under the "command" type below.
+  if (type && strcmp(type->valuestring, "sync") == 0)
   {
-    ESP_LOGE(TAG, "Socket connect failed: errno %d", errno);
-    close(sock);
-    vTaskDelete(NULL);
-    return;
+    // Perform time sync now over the UDP sync socket
+    net_request_sync();
   }
-
-  // send a sync message to server for time sync
-  int64_t t1 = esp_timer_get_time();
-  cJSON *sync_msg = cJSON_CreateObject();
-  cJSON_AddStringToObject(sync_msg, "type", "sync");
-  cJSON_AddNumberToObject(sync_msg, "t1", (double)t1);
-  char *sync_str = cJSON_PrintUnformatted(sync_msg);
-  send(sock, sync_str, strlen(sync_str), 0);
-  send(sock, "\n", 1, 0);
-  cJSON_Delete(sync_msg);
-  free(sync_str);
-
-  // receive response from server
-  while (1)
+  else if (type && strcmp(type->valuestring, "command") == 0)
   {
-    int len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
-    if (len < 0)
-    {
-      ESP_LOGE(TAG, " recv failed: errno %d", errno);
-    }
-    else if (len == 0)
-    {
-      ESP_LOGW(TAG, "Server closed");
-      break;
-    }
-    else
+    cJSON *args = cJSON_GetObjectItem(root, "args");
+    if (args && cJSON_IsArray(args))
     {
-      rx_buffer[len] = 0; // null-terminate
-      ESP_LOGI(TAG, " Received from server: %s", rx_buffer);
-      // deal with the command
-      cJSON *root = cJSON_Parse(rx_buffer);
-      if (!root)
+      int count = cJSON_GetArraySize(args);
+      if (count >= 3)
       {
-        ESP_LOGE(TAG, "fail to parse json file");
-        continue;
-      }
-      cJSON *type = cJSON_GetObjectItem(root, "type");
-      // "play" should be handled as a command under the "command" type below.
-      if (type && strcmp(type->valuestring, "sync") == 0)
-      {
-        // Perform time sync: send sync message with t1
-        int64_t t1 = esp_timer_get_time();
-        cJSON *sync_msg = cJSON_CreateObject();
-        cJSON_AddStringToObject(sync_msg, "type", "sync");
-        cJSON_AddNumberToObject(sync_msg, "t1", (double)t1);
-        char *sync_str = cJSON_PrintUnformatted(sync_msg);
-        send(sock, sync_str, strlen(sync_str), 0);
-        send(sock, "\n", 1, 0);
-        cJSON_Delete(sync_msg);
-        free(sync_str);
-      }
-      else if (type && strcmp(type->valuestring, "command") == 0)
-      {
-        cJSON *args = cJSON_GetObjectItem(root, "args");
-        if (args && cJSON_IsArray(args))
+        const char *cmd = cJSON_GetArrayItem(args, 1)->valuestring;
+        if (strcmp(cmd, "play") == 0)
+        {
+          int64_t now = esp_timer_get_time() + net_get_offset();
+          // args[2] is play delay in microseconds as string
+          const char *delay_str = cJSON_GetArrayItem(args, 2)->valuestring;
+          int64_t delay_us = atoll(delay_str);
+          int64_t execute_at = now + delay_us;
+          ESP_LOGD(TAG, "PLAY: now=%lld, delay_us=%lld, execute_at=%lld", now, delay_us, execute_at);
+          // TODO:do play, please use delay_us to calculate the time to play
+        }
+        else if (strcmp(cmd, "pause") == 0)
         {
-          int count = cJSON_GetArraySize(args);
-          if (count >= 3)
-          {
-            const char *cmd = cJSON_GetArrayItem(args, 1)->valuestring;
-            if (strcmp(cmd, "play") == 0)
-            {
-              int64_t now = esp_timer_get_time() - offset;
-              // args[2] is play delay in microseconds as string
-              const char *delay_str = cJSON_GetArrayItem(args, 2)->valuestring;
-              int64_t delay_us = atoll(delay_str);
-              int64_t execute_at = now + delay_us;
-              ESP_LOGI(TAG, "PLAY: now=%lld, delay_us=%lld, execute_at=%lld", now, delay_us, execute_at);
-              // TODO:do play, please use delay_us to calculate the time to play
-            }
-            else if (strcmp(cmd, "pause") == 0)
-            {
-              // TODO:do pause
-            }
-            else
-            {
-              ESP_LOGW(TAG, "unsupported command");
-            }
-          }
-          else
-          {
-            ESP_LOGW(TAG, "Not enough pvparameters");
-          }
+          show_pause(esp_timer_get_time() + net_get_offset());
         }
         else
         {
-          ESP_LOGW(TAG, "unsupported data type");
+          ESP_LOGW(TAG, "unsupported command");
         }
       }
-      else if (type && strcmp(type->valuestring, "sync_resp") == 0)
+      else
       {
-        // Robust offset-based time sync logic
-        cJSON *t1_item = cJSON_GetObjectItem(root, "t1");
-        cJSON *t2_item = cJSON_GetObjectItem(root, "t2");
-        cJSON *t3_item = cJSON_GetObjectItem(root, "t3");
-        if (t1_item && t2_item && t3_item &&
-            cJSON_IsNumber(t1_item) && cJSON_IsNumber(t2_item) && cJSON_IsNumber(t3_item))
+        ESP_LOGW(TAG, "Not enough pvparameters");
+      }
+    }
+    else
+    {
+      ESP_LOGW(TAG, "unsupported data type");
+    }
+  }
+  else if (type && strcmp(type->valuestring, "sched") == 0)
+  {
+    // one part of the pre-uploaded schedule: {"part":k,"parts":n,"cues":[[t_us,effect,value,dur_ms],...]}
+    cJSON *part = cJSON_GetObjectItem(root, "part");
+    cJSON *parts = cJSON_GetObjectItem(root, "parts");
+    cJSON *list = cJSON_GetObjectItem(root, "cues");
+    if (cJSON_IsNumber(part) && cJSON_IsNumber(parts) && cJSON_IsArray(list))
+    {
+      if (part->valueint == 0)
+        show_clear();
+      bool ok = true;
+      cJSON *item;
+      cJSON_ArrayForEach(item, list)
+      {
+        if (!cJSON_IsArray(item) || cJSON_GetArraySize(item) < 4)
         {
-          int64_t t1 = (int64_t)(t1_item->valuedouble);
-          int64_t t2 = (int64_t)(t2_item->valuedouble);
-          int64_t t3 = (int64_t)(t3_item->valuedouble);
-          int64_t t4 = esp_timer_get_time();
-          int64_t new_offset = ((t2 - t1) + (t3 - t4)) / 2;
-          int64_t rtt = (t4 - t1) - (t3 - t2);
-          offset = new_offset;
-          ESP_LOGI(TAG, "SYNC_RESP: t1=%lld t2=%lld t3=%lld t4=%lld offset=%lld rtt=%lld", t1, t2, t3, t4, offset, rtt);
+          ok = false;
+          continue;
         }
+        show_cue_t cue = {
+            .t_us = (int64_t)cJSON_GetArrayItem(item, 0)->valuedouble,
+            .effect = cJSON_GetArrayItem(item, 1)->valueint,
+            .value = cJSON_GetArrayItem(item, 2)->valueint,
+            .dur_ms = cJSON_GetArrayItem(item, 3)->valueint,
+        };
+        ok = show_append(&cue) && ok;
       }
-      cJSON_Delete(root);
+      // ack every part so the server knows the upload is complete before the show
+      char ack[96];
+      int n = snprintf(ack, sizeof(ack), "{\"type\":\"sched_ack\",\"part\":%d,\"count\":%d,\"ok\":%s}",
+                       part->valueint, show_cue_count(), ok ? "true" : "false");
+      net_send(ack, n);
+    }
+    else
+    {
+      ESP_LOGW(TAG, "malformed schedule part");
     }
   }
-
-  close(sock);
-  vTaskDelete(NULL);
+  else if (type && strcmp(type->valuestring, "prof") == 0)
+  {
+    // profiler export: {"type":"prof","reset":true|false}
+    static char prof_buf[2048];
+    int n = prof_format_json(prof_buf, sizeof(prof_buf));
+    if (n > 0)
+    {
+      net_send(prof_buf, n);
+    }
+    else
+    {
+      ESP_LOGW(TAG, "profiler output does not fit");
+    }
+    if (cJSON_IsTrue(cJSON_GetObjectItem(root, "reset")))
+      prof_reset();
+  }
+  else if (type && strcmp(type->valuestring, "show") == 0)
+  {
+    // show transport: {"op":"start"|"pause"|"seek","at":server_us,"pos":show_us}
+    cJSON *op = cJSON_GetObjectItem(root, "op");
+    cJSON *at = cJSON_GetObjectItem(root, "at");
+    cJSON *pos = cJSON_GetObjectItem(root, "pos");
+    if (cJSON_IsString(op) && cJSON_IsNumber(at))
+    {
+      int64_t at_us = (int64_t)at->valuedouble;
+      int64_t pos_us = cJSON_IsNumber(pos) ? (int64_t)pos->valuedouble : -1;
+      if (strcmp(op->valuestring, "start") == 0)
+        show_start(at_us, pos_us);
+      else if (strcmp(op->valuestring, "pause") == 0)
+        show_pause(at_us);
+      else if (strcmp(op->valuestring, "seek") == 0 && pos_us >= 0)
+        show_seek(at_us, pos_us);
+      else
+        ESP_LOGW(TAG, "unsupported show op");
+    }
+  }
+  else if (type && strcmp(type->valuestring, "netstat") == 0)
+  {
+    // network loop latency and queue depth
+    net_stats_t st;
+    net_get_stats(&st);
+    static char buf[512];
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"type\":\"netstat\",\"loops\":%lu,\"loop_us_last\":%lu,\"loop_us_max\":%lu,\"loop_us_avg\":%lu,"
+                     "\"depth_last\":%lu,\"depth_max\":%lu,\"tx_queued\":%lu,\"tx_queued_max\":%lu,\"tx_dropped\":%lu,"
+                     "\"timeouts\":%lu,\"connects\":%lu,\"sync_rtt_us\":%lu,\"offset\":%lld,\"stack_free\":%lu}",
+                     st.loops, st.loop_us_last, st.loop_us_max, st.loops ? (uint32_t)(st.loop_us_total / st.loops) : 0,
+                     st.depth_last, st.depth_max, st.tx_queued, st.tx_queued_max, st.tx_dropped,
+                     st.timeouts, st.connects, st.sync_rtt_us, st.offset, st.stack_free);
+    net_send(buf, n);
+  }
+  cJSON_Delete(root);
 }
 
 void app_main()
@@ -191,7 +194,11 @@ void app_main()
 
   ESP_ERROR_CHECK(esp_wifi_connect());
 
-  // after setting wifi, execute the tcp_client_task(hello world)
+  prof_decode = prof_register("json_decode");
+  tp_dump();
+  show_init();
+
+  // after setting wifi, start the network task (it keeps retrying until the server is reachable)
   vTaskDelay(5000 / portTICK_PERIOD_MS);
-  xTaskCreate(tcp_client_task, "tcp_client", 4096, NULL, 5, NULL);
+  net_start(handle_message);
 }
\ No newline at end of file
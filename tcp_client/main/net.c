@@ -0,0 +1,527 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "net.h"
+#include "show.h"
+#include "sync_proto.h"
+#include "profiler.h"
+#include "taskplace.h"
+
+static const char *TAG = "NET";
+
+#define NET_MAX_WAIT_MS 100        // upper bound of one select() so deadlines are checked often
+#define NET_SYNC_MAX_RTT_US 20000  // slower sync round trips are too noisy to use
+
+static net_message_handler_t on_message;
+static net_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static int prof_loop;
+static TaskHandle_t net_task_handle;
+
+static struct sockaddr_in server_addr;
+static struct sockaddr_in sync_addr;
+
+// TCP control connection
+static int tcp_sock = -1;
+static bool tcp_connected = false;
+static int64_t tcp_deadline = 0; // connect or send deadline, 0 = none
+static int64_t reconnect_at = 0;
+static char tx_buf[NET_TX_BUFFER];
+static int tx_len = 0;
+static char line_buf[2048];
+static int line_len = 0;
+
+// UDP sockets
+static int sync_sock = -1;
+static int cmd_sock = -1;
+static char udp_buf[1024];
+
+// sync exchange in flight
+static uint32_t sync_seq = 0;
+static bool sync_pending = false;
+static int64_t sync_deadline = 0;
+static int64_t sync_next_at = 0;
+static sync_packet_t sync_last;  // last accepted SYNC_RESP, refined by its follow-up
+static int64_t sync_last_t4 = 0;
+
+static uint32_t depth; // messages handled in the current wake-up
+
+static int64_t now_us(void)
+{
+  return esp_timer_get_time();
+}
+
+static void set_nonblocking(int fd)
+{
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// same light-weight field lookup as udp_test, enough for routing a datagram
+static int extract_value(const char *msg, const char *key, char *buffer, size_t buffer_size)
+{
+  // Build search pattern: "\"key\":"
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+
+  const char *start = strstr(msg, pattern);
+  if (!start)
+    return 0; // Not found
+
+  start += strlen(pattern);
+
+  // Skip whitespace and opening quote if present
+  while (*start == ' ' || *start == '\"')
+    start++;
+
+  const char *end = start;
+  // Value ends at quote, comma, or closing brace
+  while (*end && *end != '\"' && *end != ',' && *end != '}')
+    end++;
+
+  int len = end - start;
+  if (len <= 0 || len >= buffer_size)
+    return 0; // Invalid length or buffer too small
+
+  memcpy(buffer, start, len);
+  buffer[len] = '\0';
+  return 1; // Success
+}
+
+// ---- TCP ------------------------------------------------------------------
+
+static void tcp_close(const char *reason)
+{
+  ESP_LOGW(TAG, "control connection closed: %s", reason);
+  close(tcp_sock);
+  tcp_sock = -1;
+  tcp_connected = false;
+  tcp_deadline = 0;
+  tx_len = 0;
+  line_len = 0;
+  reconnect_at = now_us() + NET_RECONNECT_DELAY_MS * 1000LL;
+}
+
+static void tcp_on_connected(void)
+{
+  tcp_connected = true;
+  tcp_deadline = 0;
+  ESP_LOGI(TAG, "connected to %s:%d", NET_SERVER_IP, NET_SERVER_PORT);
+  // the schedule only lives in RAM: tell the server what survived (nothing after a reboot)
+  char hello[64];
+  int n = snprintf(hello, sizeof(hello), "{\"type\":\"hello\",\"id\":\"%s\",\"cues\":%d}", NET_DEVICE_ID, show_cue_count());
+  net_send(hello, n);
+  net_request_sync();
+}
+
+static void tcp_open(void)
+{
+  tcp_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  if (tcp_sock < 0)
+  {
+    ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+    reconnect_at = now_us() + NET_RECONNECT_DELAY_MS * 1000LL;
+    return;
+  }
+  set_nonblocking(tcp_sock);
+
+  // every frame is a complete message, Nagle would only hold it back
+  int one = 1;
+  setsockopt(tcp_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  // notice a dead server within ~11 s instead of never
+  int idle = 5, interval = 2, count = 3;
+  setsockopt(tcp_sock, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+  setsockopt(tcp_sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+  setsockopt(tcp_sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+  setsockopt(tcp_sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+
+  portENTER_CRITICAL(&stats_lock);
+  stats.connects++;
+  portEXIT_CRITICAL(&stats_lock);
+
+  int err = connect(tcp_sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
+  if (err == 0)
+  {
+    tcp_on_connected();
+  }
+  else if (errno == EINPROGRESS)
+  {
+    tcp_deadline = now_us() + NET_CONNECT_TIMEOUT_MS * 1000LL;
+  }
+  else
+  {
+    ESP_LOGE(TAG, "Socket connect failed: errno %d", errno);
+    tcp_close("connect failed");
+  }
+}
+
+static void tcp_flush(void)
+{
+  if (tx_len > 0)
+  {
+    int n = send(tcp_sock, tx_buf, tx_len, 0);
+    if (n > 0)
+    {
+      tx_len -= n;
+      memmove(tx_buf, tx_buf + n, tx_len);
+    }
+    else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      tcp_close("send failed");
+      return;
+    }
+  }
+  if (tx_len == 0)
+    tcp_deadline = 0;
+  else if (tcp_deadline == 0)
+    tcp_deadline = now_us() + NET_SEND_TIMEOUT_MS * 1000LL;
+}
+
+bool net_send(const char *msg, int len)
+{
+  if (!tcp_connected)
+    return false;
+  if (tx_len + len + 1 > NET_TX_BUFFER)
+  {
+    portENTER_CRITICAL(&stats_lock);
+    stats.tx_dropped++;
+    portEXIT_CRITICAL(&stats_lock);
+    return false;
+  }
+  memcpy(tx_buf + tx_len, msg, len);
+  tx_buf[tx_len + len] = '\n';
+  tx_len += len + 1;
+  tcp_flush();
+  return true;
+}
+
+static void tcp_on_writable(void)
+{
+  if (!tcp_connected)
+  {
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    getsockopt(tcp_sock, SOL_SOCKET, SO_ERROR, &err, &err_len);
+    if (err != 0)
+    {
+      ESP_LOGE(TAG, "Socket connect failed: errno %d", err);
+      tcp_close("connect failed");
+      return;
+    }
+    tcp_on_connected();
+  }
+  tcp_flush();
+}
+
+static void tcp_on_readable(void)
+{
+  // static like line_buf: the handler (cJSON, logging, replies) runs on top of this frame
+  static char rx_buffer[512];
+  while (tcp_sock >= 0)
+  {
+    int len = recv(tcp_sock, rx_buffer, sizeof(rx_buffer), 0);
+    if (len < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        tcp_close("recv failed");
+      return;
+    }
+    if (len == 0)
+    {
+      tcp_close("server closed");
+      return;
+    }
+    // one JSON message per line, a message may span several recv() calls
+    for (int i = 0; i < len && tcp_sock >= 0; ++i)
+    {
+      if (rx_buffer[i] == '\n')
+      {
+        line_buf[line_len] = 0;
+        if (line_len > 0)
+        {
+          depth++;
+          on_message(line_buf);
+        }
+        line_len = 0;
+      }
+      else if (line_len < (int)sizeof(line_buf) - 1)
+      {
+        line_buf[line_len++] = rx_buffer[i];
+      }
+      else
+      {
+        ESP_LOGE(TAG, "message too long, dropped");
+        line_len = 0;
+      }
+    }
+  }
+}
+
+// ---- UDP sync ---------------------------------------------------------------
+
+void net_request_sync(void)
+{
+  if (!sync_pending)
+    sync_next_at = 0;
+}
+
+static void sync_send(void)
+{
+  uint8_t pkt_buf[SYNC_PACKET_SIZE];
+  sync_packet_t req = {.type = SYNC_REQ, .seq = ++sync_seq};
+  int64_t now = now_us();
+  req.t1 = now;
+  sync_encode(pkt_buf, &req);
+  sendto(sync_sock, pkt_buf, sizeof(pkt_buf), 0, (struct sockaddr *)&sync_addr, sizeof(sync_addr));
+  sync_pending = true;
+  sync_deadline = now + NET_SYNC_TIMEOUT_MS * 1000LL;
+  sync_next_at = now + NET_SYNC_PERIOD_MS * 1000LL;
+}
+
+static void sync_apply(const sync_packet_t *p, int64_t t4)
+{
+  int64_t new_offset = ((p->t2 - p->t1) + (p->t3 - t4)) / 2;
+  int64_t rtt = (t4 - p->t1) - (p->t3 - p->t2);
+  if (rtt < 0 || rtt > NET_SYNC_MAX_RTT_US)
+  {
+    ESP_LOGD(TAG, "sync seq=%lu rejected, rtt=%lld", p->seq, rtt);
+    return;
+  }
+  portENTER_CRITICAL(&stats_lock);
+  stats.offset = new_offset;
+  stats.sync_rtt_us = rtt;
+  portEXIT_CRITICAL(&stats_lock);
+  show_set_offset(new_offset);
+  ESP_LOGD(TAG, "sync seq=%lu offset=%lld rtt=%lld%s", p->seq, new_offset, rtt,
+           (p->flags & SYNC_FLAG_T3_KERNEL) ? " (kernel t3)" : "");
+}
+
+static void sync_on_readable(void)
+{
+  while (1)
+  {
+    int len = recv(sync_sock, udp_buf, sizeof(udp_buf), 0);
+    int64_t t4 = now_us(); // as close to the receive as this loop gets
+    if (len < 0)
+      return;
+    depth++;
+    sync_packet_t p;
+    if (!sync_decode((const uint8_t *)udp_buf, len, &p) || p.seq != sync_seq)
+      continue; // stale or foreign
+    if (p.type == SYNC_RESP && sync_pending)
+    {
+      sync_pending = false;
+      sync_last = p;
+      sync_last_t4 = t4;
+      sync_apply(&p, t4);
+    }
+    else if (p.type == SYNC_FOLLOWUP && sync_last.seq == p.seq)
+    {
+      // same exchange, t3 replaced by the server's kernel transmit timestamp
+      sync_last.t3 = p.t3;
+      sync_last.flags = p.flags;
+      sync_apply(&sync_last, sync_last_t4);
+    }
+  }
+}
+
+// ---- UDP commands -----------------------------------------------------------
+
+static void cmd_on_readable(void)
+{
+  while (1)
+  {
+    struct sockaddr_in source_addr;
+    socklen_t socklen = sizeof(source_addr);
+    int len = recvfrom(cmd_sock, udp_buf, sizeof(udp_buf) - 1, 0, (struct sockaddr *)&source_addr, &socklen);
+    if (len < 0)
+      return;
+    udp_buf[len] = 0;
+    depth++;
+
+    char field[64];
+    // instead of using ip for target, we use an arbitrary string decided during flash
+    if (extract_value(udp_buf, "target", field, sizeof(field)) &&
+        strcmp(field, "all") != 0 && strcmp(field, NET_DEVICE_ID) != 0)
+      continue;
+
+    // ack before running the command, so a slow command cannot delay it
+    if (extract_value(udp_buf, "ack_ip", field, sizeof(field)))
+    {
+      struct sockaddr_in dest_addr = {.sin_family = AF_INET, .sin_port = htons(NET_ACK_PORT)};
+      if (inet_pton(AF_INET, field, &dest_addr.sin_addr) == 1)
+      {
+        static const char ack_msg[] = "{ \"id\": \"" NET_DEVICE_ID "\", \"status\": \"ack\" }";
+        sendto(cmd_sock, ack_msg, sizeof(ack_msg) - 1, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+      }
+    }
+    on_message(udp_buf);
+  }
+}
+
+// ---- loop -------------------------------------------------------------------
+
+static int64_t earliest(int64_t a, int64_t b)
+{
+  if (a == 0)
+    return b;
+  if (b == 0)
+    return a;
+  return (a < b) ? a : b;
+}
+
+static void net_task(void *pvParameters)
+{
+  while (1)
+  {
+    int64_t now = now_us();
+    if (tcp_sock < 0 && now >= reconnect_at)
+      tcp_open();
+    if (tcp_sock >= 0 && tcp_deadline && now >= tcp_deadline)
+    {
+      portENTER_CRITICAL(&stats_lock);
+      stats.timeouts++;
+      portEXIT_CRITICAL(&stats_lock);
+      tcp_close(tcp_connected ? "send timeout" : "connect timeout");
+    }
+    if (sync_pending && now >= sync_deadline)
+    {
+      sync_pending = false;
+      portENTER_CRITICAL(&stats_lock);
+      stats.timeouts++;
+      portEXIT_CRITICAL(&stats_lock);
+    }
+    if (!sync_pending && now >= sync_next_at)
+      sync_send();
+
+    fd_set rfds, wfds;
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    FD_SET(sync_sock, &rfds);
+    FD_SET(cmd_sock, &rfds);
+    int maxfd = (sync_sock > cmd_sock) ? sync_sock : cmd_sock;
+    if (tcp_sock >= 0)
+    {
+      if (tcp_connected)
+        FD_SET(tcp_sock, &rfds);
+      if (!tcp_connected || tx_len > 0)
+        FD_SET(tcp_sock, &wfds);
+      if (tcp_sock > maxfd)
+        maxfd = tcp_sock;
+    }
+
+    int64_t wake_at = earliest(sync_pending ? sync_deadline : sync_next_at, tcp_deadline);
+    if (tcp_sock < 0)
+      wake_at = earliest(wake_at, reconnect_at);
+    int64_t wait_us = wake_at - now;
+    if (wait_us < 0)
+      wait_us = 0;
+    if (wait_us > NET_MAX_WAIT_MS * 1000)
+      wait_us = NET_MAX_WAIT_MS * 1000;
+    struct timeval tv = {.tv_sec = 0, .tv_usec = wait_us};
+
+    int ready = select(maxfd + 1, &rfds, &wfds, NULL, &tv);
+    int64_t woke = now_us();
+    if (ready <= 0)
+      continue;
+
+    PROF_BEGIN(loop_start);
+    depth = 0;
+    // sync first: its receive timestamp is the one that suffers from waiting
+    if (FD_ISSET(sync_sock, &rfds))
+      sync_on_readable();
+    if (FD_ISSET(cmd_sock, &rfds))
+      cmd_on_readable();
+    if (tcp_sock >= 0 && FD_ISSET(tcp_sock, &wfds))
+      tcp_on_writable();
+    if (tcp_sock >= 0 && FD_ISSET(tcp_sock, &rfds))
+      tcp_on_readable();
+    PROF_END(prof_loop, loop_start);
+
+    uint32_t loop_us = now_us() - woke;
+    portENTER_CRITICAL(&stats_lock);
+    stats.loops++;
+    stats.loop_us_last = loop_us;
+    stats.loop_us_total += loop_us;
+    if (loop_us > stats.loop_us_max)
+      stats.loop_us_max = loop_us;
+    stats.depth_last = depth;
+    if (depth > stats.depth_max)
+      stats.depth_max = depth;
+    stats.tx_queued = tx_len;
+    if (tx_len > stats.tx_queued_max)
+      stats.tx_queued_max = tx_len;
+    portEXIT_CRITICAL(&stats_lock);
+  }
+}
+
+static int udp_open(int port, bool broadcast)
+{
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0)
+    return -1;
+  int one = 1;
+  if (broadcast)
+    setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+  struct sockaddr_in listen_addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons(port), // 0 = any free port
+      .sin_addr.s_addr = htonl(INADDR_ANY),
+  };
+  if (bind(sock, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) < 0)
+  {
+    close(sock);
+    return -1;
+  }
+  set_nonblocking(sock);
+  return sock;
+}
+
+void net_start(net_message_handler_t handler)
+{
+  on_message = handler;
+  prof_loop = prof_register("net_loop");
+
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(NET_SERVER_PORT);
+  server_addr.sin_addr.s_addr = inet_addr(NET_SERVER_IP);
+  sync_addr = server_addr;
+  sync_addr.sin_port = htons(SYNC_PORT);
+
+  sync_sock = udp_open(0, false);
+  cmd_sock = udp_open(NET_CMD_PORT, true);
+  if (sync_sock < 0 || cmd_sock < 0)
+  {
+    ESP_LOGE(TAG, "Unable to create UDP sockets: errno %d", errno);
+    return;
+  }
+  tp_create(TP_NET, net_task, "net", NET_TASK_STACK, NULL, &net_task_handle);
+}
+
+int64_t net_get_offset(void)
+{
+  portENTER_CRITICAL(&stats_lock);
+  int64_t offset = stats.offset;
+  portEXIT_CRITICAL(&stats_lock);
+  return offset;
+}
+
+void net_get_stats(net_stats_t *out)
+{
+  portENTER_CRITICAL(&stats_lock);
+  *out = stats;
+  portEXIT_CRITICAL(&stats_lock);
+  out->stack_free = net_task_handle ? uxTaskGetStackHighWaterMark(net_task_handle) : 0;
+}
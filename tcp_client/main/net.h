@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// One select()-driven task owns every socket of the device:
+//   TCP control connection to server.py (JSON lines, TCP_NODELAY + keepalive)
+//   UDP sync socket talking to sync_server (sync_proto.h)
+//   UDP command socket, one JSON message per datagram (same messages as over TCP)
+// Nothing in here blocks: every connect / send / sync exchange has a deadline.
+
+#define NET_SERVER_IP "192.168.0.138" // server IP
+#define NET_SERVER_PORT 5000
+#define NET_CMD_PORT 12345   // UDP commands (broadcast or unicast)
+#define NET_ACK_PORT 3333    // UDP command acks go to ack_ip:NET_ACK_PORT
+#define NET_DEVICE_ID "ESP32_A"
+
+#define NET_CONNECT_TIMEOUT_MS 3000
+#define NET_RECONNECT_DELAY_MS 2000
+#define NET_SEND_TIMEOUT_MS 500  // a TCP frame that cannot leave in this time drops the connection
+#define NET_SYNC_PERIOD_MS 1000
+#define NET_SYNC_TIMEOUT_MS 200
+#define NET_TX_BUFFER 4096
+#define NET_TASK_STACK 6144  // message handlers run on this stack, keep their buffers static
+
+typedef struct
+{
+  uint32_t loops;        // select() wake-ups
+  uint32_t loop_us_last; // time spent handling one wake-up
+  uint32_t loop_us_max;
+  uint64_t loop_us_total;
+  uint32_t depth_last;   // messages (lines + datagrams) handled in one wake-up
+  uint32_t depth_max;
+  uint32_t tx_queued;    // bytes waiting for the TCP socket right now
+  uint32_t tx_queued_max;
+  uint32_t tx_dropped;   // frames that did not fit the tx buffer
+  uint32_t timeouts;     // connect / send / sync deadlines missed
+  uint32_t connects;     // TCP connection attempts
+  uint32_t sync_rtt_us;  // round trip of the last accepted sync
+  int64_t offset;        // server time - esp_timer_get_time()
+  uint32_t stack_free;   // lowest free stack of the net task so far, bytes
+} net_stats_t;
+
+typedef void (*net_message_handler_t)(const char *msg);
+
+void net_start(net_message_handler_t handler);
+
+// the functions below are for the handler, i.e. they run on the network task
+
+// frames msg + '\n' in the preallocated tx buffer and sends it with a single send()
+bool net_send(const char *msg, int len);
+// starts a UDP sync exchange now instead of waiting for the next period
+void net_request_sync(void);
+
+// safe from any task
+int64_t net_get_offset(void);
+void net_get_stats(net_stats_t *out);
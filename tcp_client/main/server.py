@@ -4,6 +4,11 @@ import threading
 import time
 import argparse
 import logging
+import os
+import struct
+import subprocess
+
+from cuesheet import load_cue_sheet, compile_cue_sheet, schedule_messages
 
 # Setup logger
 logging.basicConfig(
@@ -15,10 +20,53 @@ logger = logging.getLogger("tcp_server")
 clients = {}
 clients_lock = threading.Lock()
 
+# schedule upload state per device ip, filled in by the sched_ack replies
+uploads = {}
+uploads_cond = threading.Condition()
+UPLOAD_ACK_TIMEOUT = 5.0  # seconds to wait for the last sched_ack
+
+
+# must match sync_proto.h
+SYNC_PORT = 5001
+SYNC_FORMAT = "<2sBBIqqq"  # magic, type, flags, seq, t1, t2, t3
+SYNC_REQ = 1
+SYNC_RESP = 2
+
+# show start is scheduled this far ahead so every device receives it before it is due
+SHOW_LEAD_US = 500_000
+
+
+def server_micro():
+    # CLOCK_MONOTONIC in microseconds: never stepped by NTP and no midnight wrap.
+    # sync_server.c reports t2/t3 on the same clock, so sync and commands share one epoch.
+    return time.monotonic_ns() // 1000
+
+
+def python_sync_responder(port):
+    # fallback when sync_server is not built: same protocol, user-space timestamps only
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("0.0.0.0", port))
+    logger.warning(f"sync_server not found, python sync responder on udp/{port}")
+    while True:
+        data, addr = sock.recvfrom(64)
+        t_2 = server_micro()
+        try:
+            magic, kind, _, seq, t_1, _, _ = struct.unpack(SYNC_FORMAT, data)
+        except struct.error:
+            continue
+        if magic != b"TS" or kind != SYNC_REQ:
+            continue
+        resp = struct.pack(SYNC_FORMAT, b"TS", SYNC_RESP, 0, seq, t_1, t_2, server_micro())
+        sock.sendto(resp, addr)
+
 
-def day_micro():
-    return int(time.time() % 86400 * 1_000_000)
-    # as a notice, if you test lightdance over midnight, you have to run it again.
+def start_sync_responder(port, binary):
+    if binary and os.access(binary, os.X_OK):
+        logger.info(f"starting {binary} on udp/{port}")
+        return subprocess.Popen([binary, str(port)])
+    threading.Thread(target=python_sync_responder,
+                     args=(port,), daemon=True).start()
+    return None
 
 
 def handle_client(client, addr):
@@ -36,22 +84,73 @@ def handle_client(client, addr):
                 except Exception as e:
                     logger.error(f"JSON decode error from {addr}: {e}")
                     continue
-                if msg.get("type") == "sync":
-                    t_1 = msg.get("t_1")
-                    t_2 = day_micro()
-                    sync_resp = {
-                        "type": "sync_resp",
-                        "t_2": t_2,
-                        "t_3": day_micro()
-                    }
-                    client.sendall((json.dumps(sync_resp) + '\n').encode())
+                # time sync is UDP only (sync_server / python_sync_responder)
+                if msg.get("type") == "sched_ack":
+                    level = logging.INFO if msg.get("ok") else logging.ERROR
+                    logger.log(
+                        level, f"schedule part {msg.get('part')} stored on {addr}, {msg.get('count')} cues")
+                    record_sched_ack(addr[0], msg)
+
+                elif msg.get("type") == "hello":
+                    record_hello(addr[0], msg)
+
+                elif msg.get("type") == "prof":
+                    mhz = msg.get("mhz") or 1
+                    for sec in msg.get("sections", []):
+                        logger.info(
+                            f"prof {addr[0]} {sec['name']:<16} core{sec['core']} n={sec['n']} "
+                            f"min={sec['min'] / mhz:.1f}us mean={sec['mean'] / mhz:.1f}us "
+                            f"max={sec['max'] / mhz:.1f}us hist(log2 cycles)={sec['hist']}")
+
+                elif msg.get("type") == "netstat":
                     logger.info(
-                        f"sync from {addr}, t_1={t_1}, t_2={t_2}, t_3={sync_resp['t_3']}")
+                        f"net {addr[0]} loop last/avg/max={msg['loop_us_last']}/{msg['loop_us_avg']}/"
+                        f"{msg['loop_us_max']}us depth last/max={msg['depth_last']}/{msg['depth_max']} "
+                        f"tx={msg['tx_queued']}B (max {msg['tx_queued_max']}B, dropped {msg['tx_dropped']}) "
+                        f"timeouts={msg['timeouts']} connects={msg['connects']} "
+                        f"sync rtt={msg['sync_rtt_us']}us offset={msg['offset']}us "
+                        f"stack free={msg.get('stack_free')}B")
 
                 # ...handle other message types if needed...
         except Exception as e:
             logger.error(f"client {addr} error: {e}")
             break
+    # a connection lost mid-upload leaves a partial schedule on the device, and a device
+    # that went away may come back rebooted with none at all
+    with clients_lock:
+        current = clients.get(addr[0]) is client
+    if current:
+        invalidate_upload(addr[0], "connection closed")
+
+
+def invalidate_upload(ip, reason):
+    # the schedule lives only in device RAM: after a disconnect it must be confirmed again
+    with uploads_cond:
+        state = uploads.get(ip)
+        if state is None:
+            return
+        if state["status"] == "pending":
+            state["status"] = "failed"
+            state["reason"] = f"{reason} during upload"
+        elif state["status"] == "ok":
+            state["status"] = "unconfirmed"
+            state["reason"] = f"{reason}, waiting for the device's cue count"
+        uploads_cond.notify_all()
+
+
+def record_hello(ip, msg):
+    # sent by the device on every (re)connect with the number of cues it holds
+    with uploads_cond:
+        state = uploads.get(ip)
+        if state is None or state["status"] != "unconfirmed":
+            return
+        if msg.get("cues") == state["expected"]:
+            state["status"] = "ok"
+            logger.info(f"{ip} reconnected, schedule of {state['expected']} cues still there")
+        else:
+            state["status"] = "failed"
+            state["reason"] = f"device holds {msg.get('cues')} of {state['expected']} cues after reconnect"
+            logger.error(f"{ip} lost its schedule, run load again")
 
 
 def receiveClient(server):
@@ -60,6 +159,8 @@ def receiveClient(server):
             client, addr = server.accept()  # accept a client
             with clients_lock:
                 clients[addr[0]] = client
+            # the old connection may be half-open and never error, so do not wait for its handler
+            invalidate_upload(addr[0], "reconnected")
             logger.info(f"current clients: {len(clients)}")
         except Exception as e:
             logger.error(f"Error {e}")
@@ -70,6 +171,104 @@ def receiveClient(server):
             client, addr), daemon=True).start()
 
 
+def broadcast_sync():
+    # Inform clients to sync before play
+    sync_json = json.dumps({"type": "sync"}) + '\n'
+    with clients_lock:
+        for c in clients.values():
+            try:
+                c.sendall(sync_json.encode())
+            except Exception as e:
+                logger.error(f"failed to send sync due to {e}")
+
+
+def record_sched_ack(ip, msg):
+    with uploads_cond:
+        state = uploads.get(ip)
+        if state is None or state["status"] != "pending":
+            return
+        if not msg.get("ok"):
+            state["status"] = "failed"
+            state["reason"] = f"part {msg.get('part')} rejected"
+        else:
+            state["acked"].add(msg.get("part"))
+            if len(state["acked"]) == state["parts"]:
+                # the last ack carries the device's total, anything else is a partial schedule
+                if msg.get("count") == state["expected"]:
+                    state["status"] = "ok"
+                else:
+                    state["status"] = "failed"
+                    state["reason"] = f"device holds {msg.get('count')} of {state['expected']} cues"
+        uploads_cond.notify_all()
+
+
+def upload_cue_sheet(path, addr=None):
+    # compile the cue sheet and push each device its own schedule before the show
+    try:
+        sheet = load_cue_sheet(path)
+        with clients_lock:
+            connected = list(clients.keys())
+        schedules = compile_cue_sheet(sheet, connected)
+    except Exception as e:
+        logger.error(f"failed to compile {path}: {e}")
+        return False
+    targeted, sent = [], []
+    with clients_lock:
+        for ip, cues in schedules.items():
+            if addr is not None and ip != addr:
+                continue
+            if ip not in clients:
+                logger.warning(f"{ip} is in the cue sheet but not connected")
+                continue
+            messages = list(schedule_messages(cues))
+            with uploads_cond:
+                uploads[ip] = {"status": "pending", "expected": len(cues),
+                               "parts": len(messages), "acked": set(), "reason": ""}
+            targeted.append(ip)
+            try:
+                for msg in messages:
+                    clients[ip].sendall(
+                        (json.dumps(msg, separators=(",", ":")) + '\n').encode())
+                sent.append(ip)
+            except Exception as e:
+                with uploads_cond:
+                    uploads[ip]["status"] = "failed"
+                    uploads[ip]["reason"] = f"send failed: {e}"
+                logger.error(f"failed to upload schedule to {ip} due to {e}")
+
+    # wait for every device to confirm its whole schedule
+    deadline = time.monotonic() + UPLOAD_ACK_TIMEOUT
+    with uploads_cond:
+        while any(uploads[ip]["status"] == "pending" for ip in sent):
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                break
+            uploads_cond.wait(remaining)
+        ok = True
+        for ip in targeted:
+            state = uploads[ip]
+            if state["status"] == "pending":
+                state["status"] = "failed"
+                state["reason"] = "no ack"
+            if state["status"] == "ok":
+                logger.info(f"uploaded {state['expected']} cues to {ip}")
+            else:
+                ok = False
+                logger.error(f"schedule upload to {ip} failed: {state['reason']}")
+    return ok
+
+
+def uploads_confirmed(addr=None):
+    # start is refused until every targeted device has confirmed a complete schedule
+    with clients_lock:
+        targets = [addr] if addr is not None else list(clients.keys())
+    with uploads_cond:
+        missing = [ip for ip in targets if uploads.get(ip, {}).get("status") != "ok"]
+    for ip in missing:
+        logger.error(f"{ip} has no confirmed schedule, run load first")
+    return not missing
+
+
 def parse_input(user_input, addr=None) -> tuple | None:
     # split user_input and divide cmd as well as args
     tokens = user_input.split()
@@ -91,18 +290,7 @@ def parse_input(user_input, addr=None) -> tuple | None:
                 logger.warning("Invalid seconds value")
                 return None
 
-            # Inform clients to sync before play
-            sync_msg = {
-                "type": "sync"
-            }
-            sync_json = json.dumps(sync_msg) + '\n'
-            with clients_lock:
-                for c in clients.values():
-                    try:
-                        c.sendall(sync_json.encode())
-                    except Exception as e:
-                        logger.error(f"failed to send sync due to {e}")
-
+            broadcast_sync()
             time.sleep(0.1)  # Wait 100ms for clients to process sync
 
             args = ["playerctl", "play", str(
@@ -110,9 +298,53 @@ def parse_input(user_input, addr=None) -> tuple | None:
             return {
                 "type": "command",
                 "args": args,
-                "t_send": day_micro()
+                "t_send": server_micro()
+            }, addr
+        case "load":
+            if len(tokens) != 2:
+                logger.warning("Usage: load <cuesheet.json>")
+                return None
+            return {
+                "type": "load",
+                "args": tokens[1:]
+            }, addr
+        case "start" | "seek":
+            # start [seconds] / seek <seconds>, show position on the uploaded schedule
+            if len(tokens) > 2 or (cmd == "seek" and len(tokens) != 2):
+                logger.warning(f"Usage: {cmd} <seconds>")
+                return None
+            try:
+                pos = int(float(tokens[1]) * 1_000_000) if len(tokens) == 2 else -1
+            except ValueError:
+                logger.warning("Invalid seconds value")
+                return None
+            if not uploads_confirmed(addr):
+                return None
+            if cmd == "start":
+                broadcast_sync()
+                time.sleep(0.1)  # Wait 100ms for clients to process sync
+            return {
+                "type": "show",
+                "op": cmd,
+                "at": server_micro() + SHOW_LEAD_US,
+                "pos": pos
+            }, addr
+        case "pause":
+            return {
+                "type": "show",
+                "op": "pause",
+                "at": server_micro()
+            }, addr
+        case "prof":
+            # prof [reset]: fetch the on-device section profiler
+            return {
+                "type": "prof",
+                "reset": tokens[1:] == ["reset"]
             }, addr
-        case "pause" | "stop" | "restart" | "quit":
+        case "net":
+            # network task loop latency, queue depth and sync quality
+            return {"type": "netstat"}, addr
+        case "stop" | "restart" | "quit":
             args = ["playerctl", cmd]
         case "list":
             args = ["list"]
@@ -144,6 +376,7 @@ def main(args):
     server.bind((HOST, PORT))  # .bind(IPaddress, port)
     server.listen(30)  # start to listen, .listen(max amount clients in line)
     logger.info(f"listening on {server.getsockname()[0]}")
+    sync_proc = start_sync_responder(args.sync_port, args.sync_bin)
     client_thread = threading.Thread(
         target=receiveClient, args=(server,), daemon=True)
     client_thread.start()
@@ -169,7 +402,9 @@ def main(args):
             # turn it into json style
             if command is not None:
                 command, addr = command
-                if command.get("type") == "check":
+                if command.get("type") == "load":
+                    upload_cue_sheet(command["args"][0], addr)
+                elif command.get("type") == "check":
                     # sometimes, not all user input is going to be remote command
                     if command["args"][0] == "list":
                         # list all connected clients
@@ -202,6 +437,8 @@ def main(args):
         for c in clients.values():
             c.close()
     server.close()
+    if sync_proc is not None:
+        sync_proc.terminate()
     logger.info("finish connection")
 
 
@@ -210,6 +447,10 @@ if __name__ == "__main__":
     parser.add_argument("--host", default="0.0.0.0", help="Host to bind")
     parser.add_argument("--port", type=int, default=5000,
                         help="Port to listen")
+    parser.add_argument("--sync-port", type=int, default=SYNC_PORT,
+                        help="UDP port of the time-sync responder")
+    parser.add_argument("--sync-bin", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "sync_server"),
+                        help="Path to the compiled sync_server responder")
     parser.add_argument("--debug", action="store_true",
                         help="Enable debug mode")
     parser.add_argument("--help", action="store_true",
@@ -222,17 +463,25 @@ if __name__ == "__main__":
 
     This server listens for TCP connections from clients and allows you to send commands to them.
     Usage:
-      python server.py [--host HOST] [--port PORT] [--debug] [--help]
+      python server.py [--host HOST] [--port PORT] [--sync-port PORT] [--sync-bin PATH] [--debug] [--help]
 
     Options:
       --host      Host/IP to bind to (default: 0.0.0.0)
       --port      Port to listen on (default: 5000)
+      --sync-port UDP port of the time-sync responder (default: 5001)
+      --sync-bin  sync_server binary (build: gcc -O2 -o sync_server sync_server.c),
+                  falls back to a python responder if it is missing
       --debug     Enable debug logging
       --help      Show this help message
 
     Commands (enter at SERVER: prompt):
       play <seconds>      Start playback for <seconds> seconds (sends sync first)
-      pause               Pause playback
+      load <file.json>    Compile a cue sheet, upload each device its schedule and wait for the acks
+      start [seconds]     Start the uploaded show (from <seconds>, or resume), refused until load is confirmed
+      seek <seconds>      Jump the show to <seconds>
+      pause               Pause the show
+      prof [reset]        Print the device section profiles (and clear them)
+      net                 Print the device network loop statistics
       stop                Stop playback
       restart             Restart playback
       list                List all connected clients
@@ -0,0 +1,284 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/ledc.h"
+
+#include "show.h"
+#include "profiler.h"
+#include "taskplace.h"
+
+static const char *TAG = "SHOW";
+
+#define SHOW_LEDC_MODE LEDC_LOW_SPEED_MODE
+#define SHOW_LEDC_CHANNEL LEDC_CHANNEL_0
+
+static show_cue_t cues[SHOW_MAX_CUES];
+static int cue_count = 0;
+static int next_cue = 0;
+
+static bool playing = false;
+static int64_t origin_us = 0;  // server time at which the show position was 0 (while playing)
+static int64_t paused_pos = 0; // show position while paused
+static int64_t clock_offset = 0;
+
+// start / seek take effect at their synchronized server time, until then the old state runs on
+static bool pending = false;
+static bool pending_play;
+static int64_t pending_at_us;
+static int64_t pending_pos_us;
+
+static SemaphoreHandle_t show_mutex;
+static TaskHandle_t show_task_handle;
+static esp_timer_handle_t wake_timer;
+static int prof_tick;
+
+static int64_t server_now(void)
+{
+  return esp_timer_get_time() + clock_offset;
+}
+
+// first cue with t_us >= pos
+static int lower_bound(int64_t pos)
+{
+  int lo = 0, hi = cue_count;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (cues[mid].t_us < pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// runs on the show task only: LEDC calls can block (see below)
+static void run_cue(const show_cue_t *cue)
+{
+  // ledc_set_duty / ledc_set_fade_with_time wait for a running fade to finish,
+  // a new cue replaces the fade instead
+  ledc_fade_stop(SHOW_LEDC_MODE, SHOW_LEDC_CHANNEL);
+  switch (cue->effect)
+  {
+  case SHOW_EFFECT_OFF:
+    ledc_set_duty(SHOW_LEDC_MODE, SHOW_LEDC_CHANNEL, 0);
+    ledc_update_duty(SHOW_LEDC_MODE, SHOW_LEDC_CHANNEL);
+    break;
+  case SHOW_EFFECT_ON:
+    ledc_set_duty(SHOW_LEDC_MODE, SHOW_LEDC_CHANNEL, cue->value);
+    ledc_update_duty(SHOW_LEDC_MODE, SHOW_LEDC_CHANNEL);
+    break;
+  case SHOW_EFFECT_FADE:
+    ledc_set_fade_with_time(SHOW_LEDC_MODE, SHOW_LEDC_CHANNEL, cue->value, cue->dur_ms);
+    ledc_fade_start(SHOW_LEDC_MODE, SHOW_LEDC_CHANNEL, LEDC_FADE_NO_WAIT);
+    break;
+  default:
+    ESP_LOGW(TAG, "unknown effect %d", cue->effect);
+    break;
+  }
+}
+
+// jumping into the middle of the show: put the LED where the last skipped cue left it
+static void restore_state(int index)
+{
+  if (index > 0)
+  {
+    show_cue_t cue = cues[index - 1];
+    if (cue.effect == SHOW_EFFECT_FADE)
+      cue.effect = SHOW_EFFECT_ON;
+    run_cue(&cue);
+  }
+  else
+  {
+    show_cue_t off = {.effect = SHOW_EFFECT_OFF};
+    run_cue(&off);
+  }
+}
+
+static void apply_pending(void)
+{
+  pending = false;
+  next_cue = lower_bound(pending_pos_us);
+  restore_state(next_cue);
+  playing = pending_play;
+  if (playing)
+    origin_us = pending_at_us - pending_pos_us;
+  else
+    paused_pos = pending_pos_us;
+}
+
+// applies a due start / seek, runs every cue that is due and arms the timer for whichever
+// comes next, called with show_mutex held
+static void show_tick(void)
+{
+  PROF_SCOPE(prof_tick);
+  esp_timer_stop(wake_timer);
+  int64_t now = server_now();
+  if (pending && now >= pending_at_us)
+    apply_pending();
+
+  int64_t wake_in = -1;
+  if (playing)
+  {
+    int64_t pos = now - origin_us;
+    while (next_cue < cue_count && cues[next_cue].t_us <= pos)
+    {
+      run_cue(&cues[next_cue]);
+      ESP_LOGD(TAG, "cue %d at pos=%lld (late %lld us)", next_cue, pos, pos - cues[next_cue].t_us);
+      next_cue++;
+    }
+    if (next_cue < cue_count)
+      wake_in = cues[next_cue].t_us - pos;
+  }
+  if (pending && (wake_in < 0 || pending_at_us - now < wake_in))
+    wake_in = pending_at_us - now;
+  if (wake_in >= 0)
+    esp_timer_start_once(wake_timer, wake_in);
+}
+
+static void wake_timer_cb(void *arg)
+{
+  xTaskNotifyGive(show_task_handle);
+}
+
+static void show_task(void *pvParameters)
+{
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xSemaphoreTake(show_mutex, portMAX_DELAY);
+    show_tick();
+    xSemaphoreGive(show_mutex);
+  }
+}
+
+void show_init(void)
+{
+  ledc_timer_config_t timer = {
+      .speed_mode = SHOW_LEDC_MODE,
+      .duty_resolution = LEDC_TIMER_8_BIT,
+      .timer_num = LEDC_TIMER_0,
+      .freq_hz = 5000,
+      .clk_cfg = LEDC_AUTO_CLK,
+  };
+  ESP_ERROR_CHECK(ledc_timer_config(&timer));
+  ledc_channel_config_t channel = {
+      .gpio_num = SHOW_LED_GPIO,
+      .speed_mode = SHOW_LEDC_MODE,
+      .channel = SHOW_LEDC_CHANNEL,
+      .timer_sel = LEDC_TIMER_0,
+      .duty = 0,
+  };
+  ESP_ERROR_CHECK(ledc_channel_config(&channel));
+  ESP_ERROR_CHECK(ledc_fade_func_install(0));
+
+  prof_tick = prof_register("show_tick");
+  show_mutex = xSemaphoreCreateMutex();
+  esp_timer_create_args_t timer_args = {
+      .callback = wake_timer_cb,
+      .name = "show_wake",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &wake_timer));
+  tp_create(TP_SHOW, show_task, "show", 4096, NULL, &show_task_handle);
+}
+
+void show_clear(void)
+{
+  xSemaphoreTake(show_mutex, portMAX_DELAY);
+  playing = false;
+  pending = false;
+  paused_pos = 0;
+  cue_count = 0;
+  next_cue = 0;
+  esp_timer_stop(wake_timer);
+  xSemaphoreGive(show_mutex);
+}
+
+bool show_append(const show_cue_t *cue)
+{
+  bool ok;
+  xSemaphoreTake(show_mutex, portMAX_DELAY);
+  ok = cue_count < SHOW_MAX_CUES && (cue_count == 0 || cues[cue_count - 1].t_us <= cue->t_us);
+  if (ok)
+    cues[cue_count++] = *cue;
+  xSemaphoreGive(show_mutex);
+  return ok;
+}
+
+int show_cue_count(void)
+{
+  return cue_count;
+}
+
+void show_start(int64_t at_us, int64_t pos_us)
+{
+  xSemaphoreTake(show_mutex, portMAX_DELAY);
+  if (pos_us < 0)
+  {
+    // resume: a bare start while playing (or about to be) must not jump back to the last pause
+    if (pending ? pending_play : playing)
+    {
+      xSemaphoreGive(show_mutex);
+      ESP_LOGD(TAG, "already playing, start ignored");
+      return;
+    }
+    pos_us = pending ? pending_pos_us : paused_pos;
+  }
+  pending = true;
+  pending_play = true;
+  pending_at_us = at_us;
+  pending_pos_us = pos_us;
+  xSemaphoreGive(show_mutex);
+  ESP_LOGD(TAG, "start at %lld from pos=%lld, in %lld us", at_us, pos_us, at_us - server_now());
+  xTaskNotifyGive(show_task_handle);
+}
+
+void show_pause(int64_t at_us)
+{
+  xSemaphoreTake(show_mutex, portMAX_DELAY);
+  if (pending && at_us >= pending_at_us)
+  {
+    // a start / seek due before the pause still happens first: fold the pause into it and
+    // leave applying it (and the LED restore) to show_tick, never touch LEDC from here
+    if (pending_play)
+      pending_pos_us += at_us - pending_at_us;
+    pending_play = false;
+  }
+  else
+  {
+    // a later start / seek is dropped
+    pending = false;
+    if (playing)
+    {
+      paused_pos = at_us - origin_us;
+      playing = false;
+    }
+  }
+  xSemaphoreGive(show_mutex);
+  ESP_LOGD(TAG, "pause at pos=%lld", paused_pos);
+  xTaskNotifyGive(show_task_handle);
+}
+
+void show_seek(int64_t at_us, int64_t pos_us)
+{
+  xSemaphoreTake(show_mutex, portMAX_DELAY);
+  if (!pending)
+    pending_play = playing;
+  pending = true;
+  pending_at_us = at_us;
+  pending_pos_us = pos_us;
+  xSemaphoreGive(show_mutex);
+  ESP_LOGD(TAG, "seek to pos=%lld", pos_us);
+  xTaskNotifyGive(show_task_handle);
+}
+
+void show_set_offset(int64_t offset)
+{
+  xSemaphoreTake(show_mutex, portMAX_DELAY);
+  clock_offset = offset;
+  xSemaphoreGive(show_mutex);
+  // re-arm the wake timer against the corrected clock
+  xTaskNotifyGive(show_task_handle);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Pre-uploaded cue schedule that is executed locally against synced server time.
+// The server uploads the whole schedule before the show; during the show only
+// start / pause / seek and clock corrections go over the network.
+
+#define SHOW_MAX_CUES 512
+#define SHOW_LED_GPIO 2 // built-in LED on most ESP32 dev boards
+
+typedef enum
+{
+  SHOW_EFFECT_OFF = 0,
+  SHOW_EFFECT_ON = 1,   // value = brightness 0..255
+  SHOW_EFFECT_FADE = 2, // fade to value over dur_ms
+} show_effect_t;
+
+typedef struct
+{
+  int64_t t_us;    // show-relative time
+  uint8_t effect;  // show_effect_t
+  uint8_t value;
+  uint16_t dur_ms;
+} show_cue_t;
+
+void show_init(void);
+
+// schedule upload, cues must arrive sorted by t_us. show_clear also stops playback
+void show_clear(void);
+bool show_append(const show_cue_t *cue);
+int show_cue_count(void);
+
+// all times are server time (CLOCK_MONOTONIC us on the server).
+// show_start with pos_us < 0 resumes from where show_pause stopped (no-op while playing).
+// start and seek (including the LED state they restore) take effect at at_us, not on arrival
+void show_start(int64_t at_us, int64_t pos_us);
+void show_pause(int64_t at_us);
+void show_seek(int64_t at_us, int64_t pos_us);
+
+// server time = esp_timer_get_time() + offset, called after every sync
+void show_set_offset(int64_t offset);
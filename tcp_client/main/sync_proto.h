@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+
+// Wire format of the UDP time-sync exchange, shared by the firmware and sync_server.c.
+// Request and reply have the same size so both directions see the same serialization delay.
+//
+// device -> server  SYNC_REQ  t1 = device clock at send
+// server -> device  SYNC_RESP t1 echoed, t2 = server receive time, t3 = server send time
+// server -> device  SYNC_FOLLOWUP (optional) t3 replaced by the kernel transmit timestamp
+//
+// All server times are CLOCK_MONOTONIC in microseconds, the same epoch server.py uses for commands.
+
+#define SYNC_PORT 5001
+#define SYNC_MAGIC0 'T'
+#define SYNC_MAGIC1 'S'
+
+#define SYNC_REQ 1
+#define SYNC_RESP 2
+#define SYNC_FOLLOWUP 3
+
+#define SYNC_FLAG_T2_KERNEL 0x01 // t2 is a kernel receive timestamp
+#define SYNC_FLAG_T3_KERNEL 0x02 // t3 is a kernel transmit timestamp
+
+#define SYNC_PACKET_SIZE 32
+
+typedef struct
+{
+  uint8_t type;
+  uint8_t flags;
+  uint32_t seq;
+  int64_t t1;
+  int64_t t2;
+  int64_t t3;
+} sync_packet_t;
+
+static inline void sync_put64(uint8_t *p, int64_t v)
+{
+  for (int i = 0; i < 8; ++i)
+    p[i] = (uint8_t)((uint64_t)v >> (8 * i));
+}
+
+static inline int64_t sync_get64(const uint8_t *p)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < 8; ++i)
+    v |= (uint64_t)p[i] << (8 * i);
+  return (int64_t)v;
+}
+
+// little-endian: magic[2] type flags seq[4] t1[8] t2[8] t3[8]
+static inline void sync_encode(uint8_t *buf, const sync_packet_t *pkt)
+{
+  buf[0] = SYNC_MAGIC0;
+  buf[1] = SYNC_MAGIC1;
+  buf[2] = pkt->type;
+  buf[3] = pkt->flags;
+  for (int i = 0; i < 4; ++i)
+    buf[4 + i] = (uint8_t)(pkt->seq >> (8 * i));
+  sync_put64(buf + 8, pkt->t1);
+  sync_put64(buf + 16, pkt->t2);
+  sync_put64(buf + 24, pkt->t3);
+}
+
+// returns 0 when buf is not a sync packet
+static inline int sync_decode(const uint8_t *buf, int len, sync_packet_t *pkt)
+{
+  if (len != SYNC_PACKET_SIZE || buf[0] != SYNC_MAGIC0 || buf[1] != SYNC_MAGIC1)
+    return 0;
+  pkt->type = buf[2];
+  pkt->flags = buf[3];
+  pkt->seq = 0;
+  for (int i = 0; i < 4; ++i)
+    pkt->seq |= (uint32_t)buf[4 + i] << (8 * i);
+  pkt->t1 = sync_get64(buf + 8);
+  pkt->t2 = sync_get64(buf + 16);
+  pkt->t3 = sync_get64(buf + 24);
+  return 1;
+}
@@ -0,0 +1,205 @@
+// Dedicated UDP time-sync responder for the lightdance server (Linux host, not firmware).
+// gcc -O2 -o sync_server sync_server.c && ./sync_server [port]
+//
+// t2/t3 are taken as close to the wire as possible: kernel receive/transmit timestamps via
+// SO_TIMESTAMPING, falling back to clock_gettime() around recvmsg/sendto when the kernel
+// does not provide them. Everything is reported on CLOCK_MONOTONIC, which NTP never steps
+// and which does not wrap at midnight, so it is the same epoch server.py uses.
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+#include "sync_proto.h"
+
+#define TX_TSTAMP_WAIT_MS 2 // how long to wait for the kernel transmit timestamp
+
+static int64_t ts_to_us(const struct timespec *ts)
+{
+  return (int64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+static int64_t clock_us(clockid_t id)
+{
+  struct timespec ts;
+  clock_gettime(id, &ts);
+  return ts_to_us(&ts);
+}
+
+// kernel software timestamps are CLOCK_REALTIME, translate them to CLOCK_MONOTONIC.
+// the two clocks are sampled back to back right now, so an NTP step only matters if it
+// lands between the packet and this call
+static int64_t realtime_to_mono_us(const struct timespec *rt)
+{
+  int64_t m1 = clock_us(CLOCK_MONOTONIC);
+  int64_t r = clock_us(CLOCK_REALTIME);
+  int64_t m2 = clock_us(CLOCK_MONOTONIC);
+  return ts_to_us(rt) - (r - (m1 + m2) / 2);
+}
+
+// pulls the SCM_TIMESTAMPING software stamp out of a control buffer, 0 if there is none
+static int find_timestamp(struct msghdr *msg, struct timespec *out)
+{
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm))
+  {
+    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING)
+    {
+      struct scm_timestamping *tss = (struct scm_timestamping *)CMSG_DATA(cm);
+      if (tss->ts[0].tv_sec || tss->ts[0].tv_nsec)
+      {
+        *out = tss->ts[0];
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// the kernel numbers every datagram sent on the socket (SOF_TIMESTAMPING_OPT_ID),
+// this is the number of the one whose transmit timestamp we want next
+static uint32_t tx_id = 0;
+
+// waits briefly for the transmit timestamp of datagram id, older ones are dropped
+static int read_tx_timestamp(int sock, uint32_t id, int64_t *t3)
+{
+  struct pollfd pfd = {.fd = sock, .events = 0};
+  while (poll(&pfd, 1, TX_TSTAMP_WAIT_MS) > 0 && (pfd.revents & POLLERR))
+  {
+    char control[256];
+    struct msghdr msg = {.msg_control = control, .msg_controllen = sizeof(control)};
+    if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+      return 0;
+
+    int match = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+    {
+      if (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+      {
+        struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cm);
+        match = err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && err->ee_data == id;
+      }
+    }
+    struct timespec ts;
+    if (match && find_timestamp(&msg, &ts))
+    {
+      *t3 = realtime_to_mono_us(&ts);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void tune_process(void)
+{
+  // keep the responder off the page-fault and time-slice paths if we are allowed to
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    fprintf(stderr, "[sync] mlockall failed (%s), continuing\n", strerror(errno));
+  struct sched_param sp = {.sched_priority = sched_get_priority_max(SCHED_FIFO) / 2};
+  if (sched_setscheduler(0, SCHED_FIFO, &sp) != 0)
+    fprintf(stderr, "[sync] SCHED_FIFO not permitted (%s), continuing\n", strerror(errno));
+}
+
+int main(int argc, char **argv)
+{
+  int port = (argc > 1) ? atoi(argv[1]) : SYNC_PORT;
+
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0)
+  {
+    perror("socket");
+    return 1;
+  }
+
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons(port),
+      .sin_addr.s_addr = htonl(INADDR_ANY),
+  };
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    perror("bind");
+    close(sock);
+    return 1;
+  }
+
+  int ts_flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE |
+                 SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY |
+                 SOF_TIMESTAMPING_OPT_ID;
+  int kernel_ts = setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &ts_flags, sizeof(ts_flags)) == 0;
+  if (!kernel_ts)
+    fprintf(stderr, "[sync] SO_TIMESTAMPING unavailable (%s), using user-space timestamps\n", strerror(errno));
+
+  tune_process();
+  printf("[sync] responder on udp/%d, kernel timestamps %s\n", port, kernel_ts ? "on" : "off");
+  fflush(stdout);
+
+  uint8_t rx[64];
+  uint8_t tx[SYNC_PACKET_SIZE];
+  char control[256];
+  while (1)
+  {
+    struct sockaddr_in src;
+    struct iovec iov = {.iov_base = rx, .iov_len = sizeof(rx)};
+    struct msghdr msg = {
+        .msg_name = &src,
+        .msg_namelen = sizeof(src),
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    int len = recvmsg(sock, &msg, 0);
+    int64_t t2 = clock_us(CLOCK_MONOTONIC); // fallback if the kernel gave us nothing
+    if (len < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("recvmsg");
+      break;
+    }
+
+    sync_packet_t req;
+    if (!sync_decode(rx, len, &req) || req.type != SYNC_REQ)
+      continue;
+
+    sync_packet_t resp = {.type = SYNC_RESP, .seq = req.seq, .t1 = req.t1};
+    struct timespec rx_ts;
+    if (kernel_ts && find_timestamp(&msg, &rx_ts))
+    {
+      t2 = realtime_to_mono_us(&rx_ts);
+      resp.flags |= SYNC_FLAG_T2_KERNEL;
+    }
+    resp.t2 = t2;
+    resp.t3 = clock_us(CLOCK_MONOTONIC);
+    sync_encode(tx, &resp);
+    if (sendto(sock, tx, sizeof(tx), 0, (struct sockaddr *)&src, msg.msg_namelen) < 0)
+      continue;
+    uint32_t resp_id = tx_id++;
+
+    // two-step: the reply already left with an estimated t3, correct it with the real one
+    int64_t t3;
+    if (kernel_ts && read_tx_timestamp(sock, resp_id, &t3))
+    {
+      resp.type = SYNC_FOLLOWUP;
+      resp.flags |= SYNC_FLAG_T3_KERNEL;
+      resp.t3 = t3;
+      sync_encode(tx, &resp);
+      if (sendto(sock, tx, sizeof(tx), 0, (struct sockaddr *)&src, msg.msg_namelen) >= 0)
+        tx_id++; // its timestamp is skipped by the next read_tx_timestamp()
+    }
+  }
+
+  close(sock);
+  return 0;
+}
@@ -8,6 +8,7 @@
 #include "esp_log.h"   // Logging macros
 #include "nvs_flash.h" // NVS storage (required for Wi-Fi credentials)
 #include "driver/gpio.h"
+#include "taskplace.h"
 
 #include <sys/socket.h> // Core socket functions
 #include <netinet/in.h> // sockaddr_in struct and INADDR_ANY
@@ -247,7 +248,7 @@ static void udp_client_task(void *pvParameters)
       ESP_LOGI(TAG, "Received blink command, starting LED blink sequence");
       static int blink_count = 3; // Blink 3 times
       // Create a task to handle blinking so it doesn't block UDP reception
-      xTaskCreate(led_blink_task, "led_blink", 2048, &blink_count, 5, NULL);
+      tp_create(TP_RENDER, led_blink_task, "led_blink", 2048, &blink_count, NULL);
       ESP_LOGI(TAG, "LED blink task created successfully");
     }
     else if (strcmp(cmd, "start") == 0)
@@ -293,7 +294,7 @@ void app_main(void)
   ESP_LOGI(TAG, "LED configured successfully!");
 
   // Create UDP client task
-  xTaskCreate(udp_client_task, "udp_client", 4096, NULL, 5, NULL);
+  tp_create(TP_NET, udp_client_task, "udp_client", 4096, NULL, NULL);
   ESP_LOGI(TAG, "UDP client task created successfully");
 
   // Keep app_main running (optional - could also delete this task)